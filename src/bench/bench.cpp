@@ -0,0 +1,253 @@
+/*
+ * Copyright 2023 Miklos Maroti.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+// Microbenchmarks of the hot paths, one JSON object per line on stdout:
+//
+//   diffmesh_bench [--filter substring] [--repeat count]
+//
+// The time is the best of the repeats in seconds, allocs is the average
+// number of derivative vectors put on the heap per repeat, and peak_rss_kb
+// is the high water mark of the whole process after the case finished.
+
+#include "diffreal.hpp"
+#include "object2d.hpp"
+#include "mesh2d.hpp"
+#include "stats.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/resource.h>
+
+struct Options
+{
+        std::string filter;
+        std::size_t repeat = 5;
+};
+
+static long peak_rss_kb()
+{
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+                return -1;
+        return usage.ru_maxrss;
+}
+
+// parameters as a flat list of name, value pairs
+typedef std::vector<std::pair<std::string, double>> Params;
+
+static void run_case(const Options &options, const std::string &name, const Params &params,
+                     const std::function<void()> &body)
+{
+        std::string label = name;
+        for (const auto &param : params)
+        {
+                char value[32];
+                std::snprintf(value, sizeof(value), "%g", param.second);
+                label += "/" + param.first + "=" + value;
+        }
+        if (!options.filter.empty() && label.find(options.filter) == std::string::npos)
+                return;
+
+        body(); // warm up, also fills the caches of the allocators
+
+        double best = 0.0;
+        for (std::size_t i = 0; i < options.repeat; i++)
+        {
+                auto start = std::chrono::steady_clock::now();
+                body();
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                if (i == 0 || elapsed.count() < best)
+                        best = elapsed.count();
+        }
+
+        // the allocations are counted by the stats, so in an extra untimed run
+        Stats::set_enabled(true);
+        std::size_t allocs = Derivs::num_allocations();
+        body();
+        allocs = Derivs::num_allocations() - allocs;
+        Stats::set_enabled(false);
+
+        std::printf("{\"case\": \"%s\", \"params\": {", name.c_str());
+        for (std::size_t i = 0; i < params.size(); i++)
+                std::printf("%s\"%s\": %g", i == 0 ? "" : ", ", params[i].first.c_str(), params[i].second);
+        std::printf("}, \"seconds\": %.9f, \"repeat\": %zu, \"allocs\": %zu, \"peak_rss_kb\": %ld}\n",
+                    best, options.repeat, allocs, peak_rss_kb());
+        std::fflush(stdout);
+}
+
+// a value with num_derivs dense derivatives
+static DiffReal parameter(double value, std::size_t index, std::size_t num_derivs)
+{
+        std::vector<double> derivs(num_derivs, 0.0);
+        if (num_derivs > 0)
+                derivs[index % num_derivs] = 1.0;
+        return DiffReal(value, derivs);
+}
+
+static void bench_diffreal(const Options &options)
+{
+        for (std::size_t num_derivs : {0, 4, 16, 64})
+        {
+                std::vector<DiffReal> values;
+                for (std::size_t i = 0; i < 64; i++)
+                        values.push_back(parameter(1.0 + 0.25 * i, i, num_derivs));
+
+                run_case(options, "diffreal_arith", {{"num_derivs", double(num_derivs)}}, [&]() {
+                        DiffReal sum(0.0);
+                        for (std::size_t i = 0; i + 3 < values.size(); i++)
+                                sum += values[i] * values[i + 1] - values[i + 2] / values[i + 3];
+                        if (sum.get_value() == 0.0)
+                                throw std::logic_error("unexpected zero sum");
+                });
+        }
+}
+
+static void bench_circle(const Options &options)
+{
+        for (std::size_t segments : {24, 96, 384})
+        {
+                DiffReal radius = parameter(1.0, 0, 4);
+                DiffReal width = parameter(1.0, 1, 4);
+                DiffReal height = parameter(0.5, 2, 4);
+
+                run_case(options, "circle_difference", {{"segments", double(segments)}}, [&]() {
+                        Object2d circle = Object2d::circle(radius, segments);
+                        Object2d result = circle.difference(Object2d::rectangle(width, height));
+                        if (result.num_components() == 0)
+                                throw std::logic_error("empty difference");
+                });
+        }
+}
+
+// count disjoint circles on a row, bridged by a long rectangle
+static std::vector<Object2d> make_row(std::size_t count)
+{
+        std::vector<Object2d> objects;
+        for (std::size_t i = 0; i < count; i++)
+                objects.push_back(Object2d::circle(parameter(0.4, i, 4), 24).translate(1.0 * i, 0.0));
+        return objects;
+}
+
+static void bench_boolean(const Options &options)
+{
+        for (std::size_t count : {4, 16, 64})
+        {
+                std::vector<Object2d> objects = make_row(count);
+                Object2d bridge = Object2d::rectangle(DiffReal(1.0 * count), DiffReal(0.2))
+                                      .translate(0.5 * (count - 1), 0.0);
+
+                run_case(options, "join", {{"components", double(count)}}, [&]() {
+                        Object2d result = objects[0];
+                        for (std::size_t i = 1; i < objects.size(); i++)
+                                result = result.join(objects[i]);
+                        if (result.num_components() != count)
+                                throw std::logic_error("wrong number of components");
+                });
+
+                Object2d joined = objects[0];
+                for (std::size_t i = 1; i < objects.size(); i++)
+                        joined = joined.join(objects[i]);
+
+                run_case(options, "intersection", {{"components", double(count)}}, [&]() {
+                        Object2d result = joined.intersection(bridge);
+                        if (result.num_components() != count)
+                                throw std::logic_error("wrong number of components");
+                });
+
+                run_case(options, "simplify", {{"components", double(count)}}, [&]() {
+                        Object2d result = joined.simplify(0.05);
+                        if (result.num_vertices() > joined.num_vertices())
+                                throw std::logic_error("simplify added vertices");
+                });
+        }
+}
+
+static Object2d make_domain()
+{
+        Object2d outer = Object2d::rectangle(parameter(4.0, 0, 4), parameter(2.0, 1, 4));
+        Object2d hole = Object2d::circle(parameter(0.5, 2, 4), 48).translate(parameter(1.0, 3, 4), DiffReal(0.0));
+        return outer.difference(hole);
+}
+
+static void bench_mesh(const Options &options)
+{
+        Object2d domain = make_domain();
+
+        run_case(options, "mesh_construct", {}, [&]() {
+                Mesh2d mesh(domain);
+                if (mesh.num_vertices() == 0)
+                        throw std::logic_error("empty mesh");
+        });
+
+        for (double size_bound : {1.0, 0.5, 0.25})
+        {
+                run_case(options, "refine_delaunay", {{"size_bound", size_bound}}, [&]() {
+                        Mesh2d mesh(domain);
+                        mesh.refine_delaunay(0.125, size_bound);
+                        if (mesh.num_faces() == 0)
+                                throw std::logic_error("empty mesh");
+                });
+        }
+}
+
+int main(int argc, char **argv)
+{
+        Options options;
+        for (int i = 1; i < argc; i++)
+        {
+                if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+                        options.filter = argv[++i];
+                else if (std::strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+                        options.repeat = std::strtoul(argv[++i], nullptr, 10);
+                else
+                {
+                        std::fprintf(stderr, "usage: %s [--filter substring] [--repeat count]\n", argv[0]);
+                        return 2;
+                }
+        }
+        if (options.repeat == 0)
+                options.repeat = 1;
+
+        // repeated constructions must not be answered from the cache
+        Object2d::set_memo_capacity(0);
+
+        try
+        {
+                bench_diffreal(options);
+                bench_circle(options);
+                bench_boolean(options);
+                bench_mesh(options);
+        }
+        catch (const std::exception &error)
+        {
+                std::fprintf(stderr, "error: %s\n", error.what());
+                return 1;
+        }
+        return 0;
+}
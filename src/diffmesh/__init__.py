@@ -13,27 +13,7 @@
 # You should have received a copy of the GNU General Public License
 # along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
-from ._diffmesh import (
-    CGAL_VERSION_STR,
-    DiffReal,
-    Object2d,
-    Mesh2d,
-)
+from . import _diffmesh
+from ._exports import export
 
-from . import object2d_ext
-from . import mesh2d_ext
-
-Object2d.plt_path = object2d_ext.plt_path
-Object2d.plt_arrows = object2d_ext.plt_arrows
-Object2d.plt_plot = object2d_ext.plt_plot
-
-Mesh2d.plt_triangulation = mesh2d_ext.plt_triangulation
-Mesh2d.plt_arrows = mesh2d_ext.plt_arrows
-Mesh2d.plt_plot = mesh2d_ext.plt_plot
-
-__all__ = [
-    "CGAL_VERSION_STR",
-    "DiffReal",
-    "Object2d",
-    "Mesh2d",
-]
+__all__ = export(_diffmesh, globals())
@@ -0,0 +1,64 @@
+# Copyright (C) 2023, Miklos Maroti
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# The names shared by diffmesh and diffmesh.fast, which wrap the same
+# bindings compiled with different kernels.
+
+from . import object2d_ext
+from . import mesh2d_ext
+
+NAMES = [
+    "CGAL_VERSION_STR",
+    "LAZY_EXACT",
+    "FAST_KERNEL",
+    "SIMD_LEVEL",
+    "DiffReal",
+    "Object2d",
+    "Mesh2d",
+    "Recipe",
+    "Tape",
+    "set_arena",
+    "arena_stats",
+    "reset_arena_stats",
+    "set_num_threads",
+    "get_num_threads",
+    "set_memo",
+    "memo_stats",
+    "reset_memo_stats",
+    "clear_memo",
+    "set_stats",
+    "stats",
+    "reset_stats",
+    "write_trace",
+]
+
+
+def export(module, namespace):
+    """
+    Copies the names of the compiled module into the namespace of a package
+    module, attaches the plotting helpers and returns the list for __all__.
+    """
+    for name in NAMES:
+        namespace[name] = getattr(module, name)
+
+    module.Object2d.plt_path = object2d_ext.plt_path
+    module.Object2d.plt_arrows = object2d_ext.plt_arrows
+    module.Object2d.plt_plot = object2d_ext.plt_plot
+
+    module.Mesh2d.plt_triangulation = mesh2d_ext.plt_triangulation
+    module.Mesh2d.plt_arrows = mesh2d_ext.plt_arrows
+    module.Mesh2d.plt_plot = mesh2d_ext.plt_plot
+
+    return list(NAMES)
@@ -0,0 +1,31 @@
+# Copyright (C) 2023, Miklos Maroti
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# The same classes built with double coordinates. The predicates are exact
+# on the double inputs (filtered, with a rational fallback), but constructed
+# points and lines are rounded, so booleans of nearly degenerate inputs may
+# fail. Use it as `import diffmesh.fast as dm`
+# for screening runs, the objects cannot be mixed with the exact ones. The
+# module is only built with the DIFFMESH_FAST_KERNEL cmake option.
+
+try:
+    from . import _diffmesh_fast
+except ImportError as error:
+    raise ImportError("diffmesh.fast is not available, build diffmesh with "
+                      "-DDIFFMESH_FAST_KERNEL=ON") from error
+
+from ._exports import export
+
+__all__ = export(_diffmesh_fast, globals())
@@ -21,46 +21,25 @@ def plt_triangulation(mesh: 'Mesh2d', derivs: List[float] = []) -> 'Triangulatio
     Converts a mesh to a matplotlib triangulation.
     """
     from matplotlib.tri import Triangulation
+    import numpy
 
-    xs = []
-    ys = []
+    values = mesh.values_array()
+    if len(derivs) > 0:
+        values = values + numpy.einsum(
+            "ijk,k->ij", mesh.derivs_array(len(derivs)), derivs)
 
-    def value(x):
-        v = x.value()
-        for (a, b) in zip(derivs, x.derivs()):
-            v += a * b
-        return v
-
-    for v in mesh.vertices():
-        xs.append(value(v[0]))
-        ys.append(value(v[1]))
-
-    return Triangulation(xs, ys, mesh.faces())
+    return Triangulation(values[:, 0], values[:, 1], mesh.faces_array())
 
 
 def plt_arrows(mesh: 'Mesh2d', derivs: List[float] = []) \
         -> Tuple[List[float], List[float], List[float], List[float]]:
-    xs = []
-    ys = []
-    us = []
-    vs = []
-
-    def delta(x):
-        d = 0.0
-        for (a, b) in zip(derivs, x.derivs()):
-            d += a * b
-        return d
-
-    def arrow(v):
-        xs.append(v[0].value())
-        ys.append(v[1].value())
-        us.append(delta(v[0]))
-        vs.append(delta(v[1]))
+    import numpy
 
-    for v in mesh.vertices():
-        arrow(v)
+    values = mesh.values_array()
+    deltas = numpy.einsum(
+        "ijk,k->ij", mesh.derivs_array(len(derivs)), derivs)
 
-    return xs, ys, us, vs
+    return values[:, 0], values[:, 1], deltas[:, 0], deltas[:, 1]
 
 
 def plt_plot(mesh: 'Mesh2d', derivs: None | List[float] = None):
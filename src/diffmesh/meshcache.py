@@ -0,0 +1,134 @@
+# Copyright (C) 2023, Miklos Maroti
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+import hashlib
+import os
+import sys
+
+import numpy
+
+# layout written by Mesh2d.save, see MeshFile in src/lib/meshfile.hpp
+HEADER = numpy.dtype([
+    ("magic", "S8"),
+    ("version", "<u4"),
+    ("kind", "<u4"),
+    ("num_vertices", "<u8"),
+    ("num_faces", "<u8"),
+    ("num_components", "<u8"),
+    ("num_derivs", "<u8"),
+    ("exact_size", "<u8"),
+    ("reserved", "<u8"),
+])
+MAGIC = b"DIFFMESH"
+VERSION = 1
+MESH = 1
+
+
+class MeshArrays:
+    """
+    The arrays of a saved mesh, memory mapped from the file: values V x 2,
+    faces F x 3, boundary V and derivs V x 2 x P.
+    """
+
+    def __init__(self, values, faces, boundary, derivs):
+        self.values = values
+        self.faces = faces
+        self.boundary = boundary
+        self.derivs = derivs
+
+    def num_vertices(self) -> int:
+        return self.values.shape[0]
+
+    def num_faces(self) -> int:
+        return self.faces.shape[0]
+
+    def num_derivs(self) -> int:
+        return self.derivs.shape[2]
+
+
+def load_mesh(path: str) -> MeshArrays:
+    """
+    Maps the arrays of a file written by Mesh2d.save without copying them.
+    """
+    header = numpy.fromfile(path, dtype=HEADER, count=1)
+    if len(header) != 1 or header["magic"][0] != MAGIC:
+        raise ValueError("not a mesh file")
+    header = header[0]
+    if header["version"] != VERSION:
+        raise ValueError("unsupported mesh file version")
+    if header["kind"] != MESH:
+        raise ValueError("not a mesh")
+
+    num_vertices = int(header["num_vertices"])
+    num_faces = int(header["num_faces"])
+    num_derivs = int(header["num_derivs"])
+    offset = HEADER.itemsize
+
+    def section(dtype, shape):
+        nonlocal offset
+        dtype = numpy.dtype(dtype)
+        size = int(numpy.prod(shape)) * dtype.itemsize
+        if size == 0:
+            array = numpy.empty(shape, dtype=dtype)
+        else:
+            array = numpy.memmap(path, dtype=dtype, mode="r",
+                                 offset=offset, shape=shape)
+        offset += (size + 7) // 8 * 8
+        return array
+
+    values = section("<f8", (num_vertices, 2))
+    faces = section("<i8", (num_faces, 3))
+    boundary = section("u1", (num_vertices, ))
+    derivs = section("<f8", (num_vertices, 2, num_derivs))
+    return MeshArrays(values, faces, boundary, derivs)
+
+
+class MeshCache:
+    """
+    Directory of refined meshes keyed by the hash of the input object, the
+    kernel and the refinement parameters. Meshes that are not in the cache
+    yet are built, saved and then mapped like the others.
+    """
+
+    def __init__(self, directory: str):
+        self.directory = directory
+        self.hits = 0
+        self.misses = 0
+        os.makedirs(directory, exist_ok=True)
+
+    def path(self, object: 'Object2d', aspect_bound: float, size_bound: float) -> str:
+        key = "{} {:016x} {!r} {!r} {}".format(
+            type(object).__module__, object.hash(),
+            aspect_bound, size_bound, VERSION)
+        name = hashlib.sha256(key.encode()).hexdigest()[:32]
+        return os.path.join(self.directory, name + ".mesh")
+
+    def get(self, object: 'Object2d', aspect_bound: float = 0.125,
+            size_bound: float = 0.0, exact: bool = False) -> MeshArrays:
+        path = self.path(object, aspect_bound, size_bound)
+        if os.path.exists(path):
+            self.hits += 1
+            return load_mesh(path)
+
+        self.misses += 1
+        Mesh2d = sys.modules[type(object).__module__].Mesh2d
+        mesh = Mesh2d(object)
+        mesh.refine_delaunay(aspect_bound=aspect_bound, size_bound=size_bound)
+
+        # concurrent runs may build the same mesh, the rename is atomic
+        temp = "{}.{}.tmp".format(path, os.getpid())
+        mesh.save(temp, exact=exact)
+        os.replace(temp, path)
+        return load_mesh(path)
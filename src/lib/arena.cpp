@@ -0,0 +1,331 @@
+/*
+ * Copyright 2023 Miklos Maroti.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "arena.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+
+#include <gmp.h>
+#include <sys/mman.h>
+
+static thread_local Arena *current_arena = nullptr;
+
+static std::atomic<bool> arena_enabled(false);
+static std::atomic<std::size_t> arena_chunk_size(1 << 20);
+
+static std::mutex stats_mutex;
+static Arena::Stats arena_stats = {0, 0, 0, 0};
+
+#ifdef DIFFMESH_LAZY_EXACT
+// exact values computed inside a scope are cached in lazy nodes that can
+// outlive it, so GMP limbs always stay on the heap
+static const bool arena_gmp = false;
+#else
+static const bool arena_gmp = true;
+#endif
+
+// the chunks of all arenas are carved from one reserved range of address
+// space, so a pointer from the arena of another thread is recognized by two
+// comparisons and never passed to realloc or free; only taking and returning
+// chunks locks, the pages of a returned chunk are given back to the system
+static const std::size_t REGION_SIZE = std::size_t(1) << (sizeof(void *) >= 8 ? 36 : 28);
+static const std::size_t CHUNK_GRANULE = 1 << 16;
+
+static std::atomic<char *> region_begin(nullptr);
+static std::atomic<char *> region_end(nullptr);
+static std::mutex region_mutex;
+static std::map<char *, std::size_t> free_ranges;
+
+static bool in_any_arena(const void *ptr)
+{
+        const char *p = static_cast<const char *>(ptr);
+        return p >= region_begin.load(std::memory_order_relaxed) &&
+               p < region_end.load(std::memory_order_relaxed);
+}
+
+static void reserve_region()
+{
+        void *begin = mmap(nullptr, REGION_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (begin == MAP_FAILED)
+                throw std::bad_alloc();
+
+        free_ranges[static_cast<char *>(begin)] = REGION_SIZE;
+        region_end.store(static_cast<char *>(begin) + REGION_SIZE);
+        region_begin.store(static_cast<char *>(begin));
+}
+
+// first fit, sizes are multiples of the granule
+static char *take_chunk(std::size_t size)
+{
+        std::lock_guard<std::mutex> lock(region_mutex);
+        if (region_begin.load(std::memory_order_relaxed) == nullptr)
+                reserve_region();
+
+        for (auto it = free_ranges.begin(); it != free_ranges.end(); ++it)
+        {
+                if (it->second < size)
+                        continue;
+
+                char *begin = it->first;
+                std::size_t rest = it->second - size;
+                free_ranges.erase(it);
+                if (rest > 0)
+                        free_ranges[begin + size] = rest;
+
+                if (mprotect(begin, size, PROT_READ | PROT_WRITE) != 0)
+                {
+                        free_ranges[begin] = size;
+                        throw std::bad_alloc();
+                }
+                return begin;
+        }
+        throw std::bad_alloc();
+}
+
+static void return_chunk(char *begin, std::size_t size)
+{
+        // drops the pages and makes stale accesses fault
+        mmap(begin, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+
+        std::lock_guard<std::mutex> lock(region_mutex);
+        auto next = free_ranges.lower_bound(begin);
+        if (next != free_ranges.end() && next->first == begin + size)
+        {
+                size += next->second;
+                free_ranges.erase(next);
+        }
+        auto it = free_ranges.emplace(begin, size).first;
+        if (it != free_ranges.begin())
+        {
+                auto prev = std::prev(it);
+                if (prev->first + prev->second == begin)
+                {
+                        prev->second += size;
+                        free_ranges.erase(it);
+                }
+        }
+}
+
+static void *gmp_allocate(std::size_t size)
+{
+        Arena *arena = current_arena;
+        if (arena != nullptr && arena->use_for_gmp())
+                return arena->allocate(size);
+
+        void *ptr = std::malloc(size);
+        if (ptr == nullptr)
+                std::abort();
+        return ptr;
+}
+
+static void *gmp_reallocate(void *ptr, std::size_t old_size, std::size_t new_size)
+{
+        Arena *arena = current_arena;
+        if (arena != nullptr && arena->owns(ptr))
+        {
+                if (new_size <= old_size)
+                        return ptr;
+
+                void *result = arena->allocate(new_size);
+                std::memcpy(result, ptr, old_size);
+                return result;
+        }
+
+        // limbs of a foreign arena are copied, that arena releases them
+        if (in_any_arena(ptr))
+        {
+                void *result = gmp_allocate(new_size);
+                std::memcpy(result, ptr, std::min(old_size, new_size));
+                return result;
+        }
+
+        void *result = std::realloc(ptr, new_size);
+        if (result == nullptr)
+                std::abort();
+        return result;
+}
+
+static void gmp_free(void *ptr, std::size_t)
+{
+        Arena *arena = current_arena;
+        if ((arena != nullptr && arena->owns(ptr)) || in_any_arena(ptr))
+                return;
+        std::free(ptr);
+}
+
+Arena::Arena(std::size_t chunk_size, bool use_for_gmp)
+    : d_chunk_size(chunk_size), d_use_for_gmp(use_for_gmp),
+      d_next(nullptr), d_end(nullptr), d_size(0)
+{
+}
+
+Arena::~Arena()
+{
+        for (auto &c : d_chunks)
+                return_chunk(c.begin, c.end - c.begin);
+}
+
+void *Arena::allocate(std::size_t size)
+{
+        size = (size + 15) & ~static_cast<std::size_t>(15);
+        if (size > static_cast<std::size_t>(d_end - d_next))
+                add_chunk(std::max(size, d_chunk_size));
+
+        void *ptr = d_next;
+        d_next += size;
+        d_size += size;
+        return ptr;
+}
+
+bool Arena::owns(const void *ptr) const
+{
+        const char *p = static_cast<const char *>(ptr);
+        auto it = std::upper_bound(d_chunks.begin(), d_chunks.end(), p,
+                                   [](const char *a, const Chunk &b)
+                                   { return a < b.begin; });
+        if (it == d_chunks.begin())
+                return false;
+        --it;
+        return p < it->end;
+}
+
+void Arena::add_chunk(std::size_t size)
+{
+        size = (size + CHUNK_GRANULE - 1) / CHUNK_GRANULE * CHUNK_GRANULE;
+        char *begin = take_chunk(size);
+
+        Chunk chunk = {begin, begin + size};
+        auto it = std::upper_bound(d_chunks.begin(), d_chunks.end(), begin,
+                                   [](const char *a, const Chunk &b)
+                                   { return a < b.begin; });
+        try
+        {
+                d_chunks.insert(it, chunk);
+        }
+        catch (...)
+        {
+                return_chunk(begin, size);
+                throw;
+        }
+
+        d_next = chunk.begin;
+        d_end = chunk.end;
+}
+
+Arena *Arena::current()
+{
+        return current_arena;
+}
+
+void Arena::set_enabled(bool enabled, std::size_t chunk_size)
+{
+        if (chunk_size < 4096)
+                throw std::invalid_argument("arena chunk size is too small");
+
+        if (enabled && arena_gmp)
+        {
+                static std::once_flag installed;
+                std::call_once(installed, []()
+                               { mp_set_memory_functions(gmp_allocate, gmp_reallocate, gmp_free); });
+        }
+
+        arena_chunk_size.store(chunk_size);
+        arena_enabled.store(enabled);
+}
+
+bool Arena::is_enabled()
+{
+        return arena_enabled.load();
+}
+
+Arena::Stats Arena::get_stats()
+{
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        return arena_stats;
+}
+
+void Arena::reset_stats()
+{
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        arena_stats = {0, 0, 0, 0};
+}
+
+ArenaScope::ArenaScope() : d_arena(nullptr)
+{
+        if (current_arena != nullptr || !arena_enabled.load(std::memory_order_relaxed))
+                return;
+
+        d_arena = new Arena(arena_chunk_size.load(std::memory_order_relaxed), arena_gmp);
+        current_arena = d_arena;
+}
+
+ArenaScope::~ArenaScope()
+{
+        if (d_arena == nullptr)
+                return;
+
+        current_arena = nullptr;
+        {
+                std::lock_guard<std::mutex> lock(stats_mutex);
+                arena_stats.scopes += 1;
+                arena_stats.chunks += d_arena->d_chunks.size();
+                arena_stats.peak_size = std::max(arena_stats.peak_size, d_arena->d_size);
+                arena_stats.total_size += d_arena->d_size;
+        }
+        delete d_arena;
+}
+
+ArenaScope::Suspend::Suspend() : d_saved(current_arena)
+{
+        current_arena = nullptr;
+}
+
+ArenaScope::Suspend::~Suspend()
+{
+        current_arena = d_saved;
+}
+
+void *arena_malloc(std::size_t size)
+{
+        Arena *arena = current_arena;
+        if (arena != nullptr)
+                return arena->allocate(size);
+
+        void *ptr = std::malloc(size);
+        if (ptr == nullptr && size != 0)
+                throw std::bad_alloc();
+        return ptr;
+}
+
+void arena_free(void *ptr)
+{
+        Arena *arena = current_arena;
+        if ((arena != nullptr && arena->owns(ptr)) || in_any_arena(ptr))
+                return;
+        std::free(ptr);
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2023 Miklos Maroti.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <vector>
+
+/*
+ * Bump allocator for the temporaries of one top level operation. While an
+ * ArenaScope is open on a thread, derivative buffers (and GMP limbs, unless
+ * lazy exact values are used) are carved out of large chunks, frees are
+ * no-ops and everything is released in bulk when the scope closes. Values
+ * that outlive the scope must be detached to the heap before that. The
+ * chunks of all arenas come from one reserved range of address space, so
+ * the frees of any thread tell arena pointers apart without locking.
+ */
+class Arena
+{
+public:
+        struct Stats
+        {
+                std::size_t scopes;
+                std::size_t chunks;
+                std::size_t peak_size;
+                std::size_t total_size;
+        };
+
+        Arena(std::size_t chunk_size, bool use_for_gmp);
+        ~Arena();
+
+        void *allocate(std::size_t size);
+        bool owns(const void *ptr) const;
+        bool use_for_gmp() const { return d_use_for_gmp; }
+        std::size_t size() const { return d_size; }
+
+        static Arena *current();
+
+        static void set_enabled(bool enabled, std::size_t chunk_size);
+        static bool is_enabled();
+        static Stats get_stats();
+        static void reset_stats();
+
+protected:
+        struct Chunk
+        {
+                char *begin;
+                char *end;
+        };
+
+        void add_chunk(std::size_t size);
+
+        std::size_t d_chunk_size;
+        bool d_use_for_gmp;
+        std::vector<Chunk> d_chunks;
+        char *d_next;
+        char *d_end;
+        std::size_t d_size;
+
+        friend class ArenaScope;
+};
+
+/*
+ * Opens an arena on the current thread if arenas are enabled and no scope
+ * is open yet, nested scopes share the outermost arena.
+ */
+class ArenaScope
+{
+public:
+        ArenaScope();
+        ~ArenaScope();
+
+        bool is_active() const { return d_arena != nullptr; }
+
+        // temporarily routes allocations of the current thread to the heap
+        class Suspend
+        {
+        public:
+                Suspend();
+                ~Suspend();
+
+        protected:
+                Arena *d_saved;
+        };
+
+protected:
+        Arena *d_arena;
+
+        ArenaScope(const ArenaScope &) = delete;
+        ArenaScope &operator=(const ArenaScope &) = delete;
+};
+
+void *arena_malloc(std::size_t size);
+void arena_free(void *ptr);
+
+#endif // ARENA_HPP
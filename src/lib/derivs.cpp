@@ -0,0 +1,450 @@
+/*
+ * Copyright 2023 Miklos Maroti.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "derivs.hpp"
+#include "simd.hpp"
+#include "arena.hpp"
+#include "stats.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+
+static const SimdKernels &simd = simd_kernels();
+
+Derivs::Derivs(const std::vector<double> &values)
+    : d_data(d_inline), d_index(nullptr), d_size(0), d_capacity(INLINE_SIZE)
+{
+        reserve(values.size());
+        if (!values.empty())
+                std::memcpy(d_data, values.data(), values.size() * sizeof(double));
+        d_size = values.size();
+}
+
+Derivs::Derivs(const std::vector<std::size_t> &indices, const std::vector<double> &values)
+    : d_data(d_inline), d_index(nullptr), d_size(0), d_capacity(INLINE_SIZE)
+{
+        if (indices.size() != values.size())
+                throw std::invalid_argument("indices and derivs must have the same length");
+
+        std::vector<std::pair<std::size_t, double>> entries;
+        entries.reserve(indices.size());
+        for (std::size_t i = 0; i < indices.size(); i++)
+        {
+                if (indices[i] > std::numeric_limits<Index>::max())
+                        throw std::invalid_argument("derivative index is too large");
+                entries.emplace_back(indices[i], values[i]);
+        }
+        std::sort(entries.begin(), entries.end());
+
+        make_sparse();
+        reserve(entries.size());
+        for (std::size_t i = 0; i < entries.size();)
+        {
+                Index index = entries[i].first;
+                double value = 0.0;
+                for (; i < entries.size() && entries[i].first == index; i++)
+                        value += entries[i].second;
+
+                if (value != 0.0)
+                {
+                        d_index[d_size] = index;
+                        d_data[d_size] = value;
+                        d_size += 1;
+                }
+        }
+}
+
+Derivs::Derivs(const Derivs &other)
+    : d_data(d_inline), d_index(nullptr), d_size(0), d_capacity(INLINE_SIZE)
+{
+        assign(other);
+}
+
+Derivs::Derivs(Derivs &&other) noexcept
+    : d_data(d_inline), d_index(nullptr), d_size(0), d_capacity(INLINE_SIZE)
+{
+        steal(other);
+}
+
+Derivs::~Derivs()
+{
+        release();
+}
+
+Derivs &Derivs::operator=(const Derivs &other)
+{
+        if (this != &other)
+                assign(other);
+        return *this;
+}
+
+Derivs &Derivs::operator=(Derivs &&other) noexcept
+{
+        if (this != &other)
+        {
+                release();
+                steal(other);
+        }
+        return *this;
+}
+
+std::size_t Derivs::dimension() const
+{
+        if (d_index == nullptr)
+                return d_size;
+        return d_size == 0 ? 0 : d_index[d_size - 1] + 1;
+}
+
+double Derivs::get(std::size_t index) const
+{
+        if (d_index == nullptr)
+                return index < d_size ? d_data[index] : 0.0;
+
+        const Index *pos = std::lower_bound(d_index, d_index + d_size, index);
+        if (pos == d_index + d_size || *pos != index)
+                return 0.0;
+        return d_data[pos - d_index];
+}
+
+std::vector<double> Derivs::get_dense(std::size_t dimension) const
+{
+        std::vector<double> result(dimension);
+        get_dense(result.data(), dimension);
+        return result;
+}
+
+void Derivs::get_dense(double *output, std::size_t dimension) const
+{
+        if (d_index == nullptr)
+        {
+                std::size_t size = std::min(d_size, dimension);
+                if (size != 0)
+                        std::memcpy(output, d_data, size * sizeof(double));
+                for (std::size_t i = size; i < dimension; i++)
+                        output[i] = 0.0;
+                return;
+        }
+
+        for (std::size_t i = 0; i < dimension; i++)
+                output[i] = 0.0;
+        for (std::size_t k = 0; k < d_size && d_index[k] < dimension; k++)
+                output[d_index[k]] = d_data[k];
+}
+
+void Derivs::scale(double a)
+{
+        if (d_index == nullptr)
+        {
+                simd.scale(d_data, a, d_size);
+                return;
+        }
+
+        std::size_t n = 0;
+        for (std::size_t k = 0; k < d_size; k++)
+        {
+                double value = a * d_data[k];
+                if (value != 0.0)
+                {
+                        d_index[n] = d_index[k];
+                        d_data[n] = value;
+                        n += 1;
+                }
+        }
+        d_size = n;
+}
+
+void Derivs::axpy(double a, const Derivs &x)
+{
+        if (x.d_size == 0)
+                return;
+
+        if (x.d_index != nullptr)
+        {
+                if (d_size == 0 && d_index == nullptr)
+                        make_sparse();
+
+                if (d_index != nullptr)
+                {
+                        merge(1.0, a, x);
+                        return;
+                }
+
+                std::size_t n = x.dimension();
+                if (d_size < n)
+                        resize(n);
+                for (std::size_t k = 0; k < x.d_size; k++)
+                        d_data[x.d_index[k]] += a * x.d_data[k];
+                return;
+        }
+
+        if (d_index != nullptr)
+                make_dense();
+
+        if (d_size < x.d_size)
+                resize(x.d_size);
+        simd.axpy(d_data, a, x.d_data, x.d_size);
+}
+
+void Derivs::scale_axpy(double b, double a, const Derivs &x)
+{
+        if (x.d_size == 0)
+        {
+                scale(b);
+                return;
+        }
+
+        if (x.d_index != nullptr)
+        {
+                if (d_size == 0 && d_index == nullptr)
+                        make_sparse();
+
+                if (d_index != nullptr)
+                {
+                        merge(b, a, x);
+                        return;
+                }
+
+                simd.scale(d_data, b, d_size);
+                std::size_t n = x.dimension();
+                if (d_size < n)
+                        resize(n);
+                for (std::size_t k = 0; k < x.d_size; k++)
+                        d_data[x.d_index[k]] += a * x.d_data[k];
+                return;
+        }
+
+        if (d_index != nullptr)
+                make_dense();
+
+        std::size_t n = x.d_size;
+        if (d_size < n)
+                resize(n);
+        simd.scale_axpy(d_data, b, a, x.d_data, n);
+        simd.scale(d_data + n, b, d_size - n);
+}
+
+void Derivs::reserve(std::size_t capacity)
+{
+        if (capacity <= d_capacity)
+                return;
+
+        double *data = allocate(capacity);
+        if (d_size != 0)
+                std::memcpy(data, d_data, d_size * sizeof(double));
+        if (d_data != d_inline)
+                deallocate(d_data);
+        d_data = data;
+
+        if (d_index != nullptr)
+        {
+                Index *index = allocate_index(capacity);
+                if (d_size != 0)
+                        std::memcpy(index, d_index, d_size * sizeof(Index));
+                if (d_index != d_inline_index)
+                        deallocate_index(d_index);
+                d_index = index;
+        }
+
+        d_capacity = capacity;
+}
+
+void Derivs::resize(std::size_t size)
+{
+        if (size > d_capacity)
+                reserve(std::max(size, 2 * d_capacity));
+        for (std::size_t i = d_size; i < size; i++)
+                d_data[i] = 0.0;
+        d_size = size;
+}
+
+void Derivs::make_sparse()
+{
+        assert(d_index == nullptr && d_size == 0);
+        d_index = d_data == d_inline ? d_inline_index : allocate_index(d_capacity);
+}
+
+void Derivs::make_dense()
+{
+        assert(d_index != nullptr);
+
+        // indices are strictly increasing, so d_index[k] >= k and the
+        // entries can be scattered in place starting from the last one
+        std::size_t n = dimension();
+        reserve(n);
+
+        std::size_t next = n;
+        for (std::size_t k = d_size; k-- > 0;)
+        {
+                std::size_t i = d_index[k];
+                for (std::size_t j = i + 1; j < next; j++)
+                        d_data[j] = 0.0;
+                d_data[i] = d_data[k];
+                next = i;
+        }
+        for (std::size_t j = 0; j < next; j++)
+                d_data[j] = 0.0;
+
+        if (d_index != d_inline_index)
+                deallocate_index(d_index);
+        d_index = nullptr;
+        d_size = n;
+}
+
+void Derivs::assign(const Derivs &other)
+{
+        d_size = 0;
+        if (other.d_index != nullptr && d_index == nullptr)
+                make_sparse();
+        else if (other.d_index == nullptr && d_index != nullptr)
+                make_dense();
+
+        reserve(other.d_size);
+        if (other.d_size != 0)
+        {
+                std::memcpy(d_data, other.d_data, other.d_size * sizeof(double));
+                if (d_index != nullptr)
+                        std::memcpy(d_index, other.d_index, other.d_size * sizeof(Index));
+        }
+        d_size = other.d_size;
+}
+
+void Derivs::merge(double b, double a, const Derivs &x)
+{
+        assert(d_index != nullptr && x.d_index != nullptr);
+
+        Derivs result;
+        result.make_sparse();
+        result.reserve(d_size + x.d_size);
+
+        std::size_t i = 0, j = 0, n = 0;
+        while (i < d_size || j < x.d_size)
+        {
+                Index index;
+                double value;
+                if (j == x.d_size || (i < d_size && d_index[i] < x.d_index[j]))
+                {
+                        index = d_index[i];
+                        value = b * d_data[i++];
+                }
+                else if (i == d_size || x.d_index[j] < d_index[i])
+                {
+                        index = x.d_index[j];
+                        value = a * x.d_data[j++];
+                }
+                else
+                {
+                        index = d_index[i];
+                        value = b * d_data[i++] + a * x.d_data[j++];
+                }
+
+                if (value != 0.0)
+                {
+                        result.d_index[n] = index;
+                        result.d_data[n] = value;
+                        n += 1;
+                }
+        }
+        result.d_size = n;
+
+        *this = std::move(result);
+}
+
+void Derivs::steal(Derivs &other)
+{
+        assert(d_data == d_inline && d_index == nullptr);
+
+        // heap allocated values and indices always come together
+        if (other.d_data != other.d_inline)
+        {
+                d_data = other.d_data;
+                d_index = other.d_index;
+                d_capacity = other.d_capacity;
+        }
+        else
+        {
+                if (other.d_size != 0)
+                        std::memcpy(d_inline, other.d_inline, other.d_size * sizeof(double));
+                if (other.d_index != nullptr)
+                {
+                        if (other.d_size != 0)
+                                std::memcpy(d_inline_index, other.d_inline_index, other.d_size * sizeof(Index));
+                        d_index = d_inline_index;
+                }
+        }
+        d_size = other.d_size;
+
+        other.d_data = other.d_inline;
+        other.d_index = nullptr;
+        other.d_size = 0;
+        other.d_capacity = INLINE_SIZE;
+}
+
+void Derivs::release()
+{
+        if (d_data != d_inline)
+                deallocate(d_data);
+        if (d_index != nullptr && d_index != d_inline_index)
+                deallocate_index(d_index);
+
+        d_data = d_inline;
+        d_index = nullptr;
+        d_size = 0;
+        d_capacity = INLINE_SIZE;
+}
+
+bool Derivs::in_arena() const
+{
+        Arena *arena = Arena::current();
+        if (arena == nullptr)
+                return false;
+        return (d_data != d_inline && arena->owns(d_data)) ||
+               (d_index != nullptr && d_index != d_inline_index && arena->owns(d_index));
+}
+
+std::size_t Derivs::num_allocations()
+{
+        return Stats::get_counter(Stats::DERIV_ALLOCATIONS);
+}
+
+double *Derivs::allocate(std::size_t capacity)
+{
+        Stats::count(Stats::DERIV_ALLOCATIONS);
+        return static_cast<double *>(arena_malloc(capacity * sizeof(double)));
+}
+
+void Derivs::deallocate(double *data)
+{
+        arena_free(data);
+}
+
+Derivs::Index *Derivs::allocate_index(std::size_t capacity)
+{
+        Stats::count(Stats::DERIV_ALLOCATIONS);
+        return static_cast<Index *>(arena_malloc(capacity * sizeof(Index)));
+}
+
+void Derivs::deallocate_index(Index *index)
+{
+        arena_free(index);
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright 2023 Miklos Maroti.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DERIVS_HPP
+#define DERIVS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifndef DIFFMESH_INLINE_DERIVS
+#define DIFFMESH_INLINE_DERIVS 16
+#endif
+
+/*
+ * Vector of partial derivatives. The first DIFFMESH_INLINE_DERIVS
+ * entries are stored inside the object, so models with few parameters
+ * never touch the heap when DiffReal temporaries are created.
+ *
+ * The vector is either dense, or sparse with sorted parameter indices and
+ * no exact zeros. Sparse vectors stay sparse when combined with other
+ * sparse or empty ones, and are expanded when they meet a dense one.
+ */
+class Derivs
+{
+public:
+        typedef std::uint32_t Index;
+
+        static const std::size_t INLINE_SIZE = DIFFMESH_INLINE_DERIVS;
+
+        Derivs() : d_data(d_inline), d_index(nullptr), d_size(0), d_capacity(INLINE_SIZE) {}
+        Derivs(const std::vector<double> &values);
+        Derivs(const std::vector<std::size_t> &indices, const std::vector<double> &values);
+        Derivs(const Derivs &other);
+        Derivs(Derivs &&other) noexcept;
+        ~Derivs();
+
+        Derivs &operator=(const Derivs &other);
+        Derivs &operator=(Derivs &&other) noexcept;
+
+        bool is_sparse() const { return d_index != nullptr; }
+        bool empty() const { return d_size == 0; }
+
+        // number of stored entries
+        std::size_t size() const { return d_size; }
+
+        // length of the equivalent dense vector
+        std::size_t dimension() const;
+
+        std::size_t index(std::size_t pos) const { return d_index != nullptr ? d_index[pos] : pos; }
+        double value(std::size_t pos) const { return d_data[pos]; }
+
+        double get(std::size_t index) const;
+        std::vector<double> get_dense(std::size_t dimension) const;
+        void get_dense(double *output, std::size_t dimension) const;
+
+        void clear() { d_size = 0; }
+
+        void scale(double a);
+        void axpy(double a, const Derivs &x);
+        void scale_axpy(double b, double a, const Derivs &x);
+
+        // whether the entries live in the arena of the current thread
+        bool in_arena() const;
+
+        // number of heap allocations made by all derivative vectors, counted
+        // only while the stats are enabled, since the last Stats::reset
+        static std::size_t num_allocations();
+
+protected:
+        static double *allocate(std::size_t capacity);
+        static void deallocate(double *data);
+        static Index *allocate_index(std::size_t capacity);
+        static void deallocate_index(Index *index);
+
+        void reserve(std::size_t capacity);
+        void resize(std::size_t size);
+        void make_sparse();
+        void make_dense();
+        void assign(const Derivs &other);
+        void steal(Derivs &other);
+        void release();
+        void merge(double b, double a, const Derivs &x);
+
+        double *d_data;
+        Index *d_index;
+        std::size_t d_size;
+        std::size_t d_capacity;
+        double d_inline[INLINE_SIZE];
+        Index d_inline_index[INLINE_SIZE];
+};
+
+#endif // DERIVS_HPP
@@ -18,34 +18,78 @@
  */
 
 #include "diffreal.hpp"
+#include "arena.hpp"
+
+#include <cmath>
 
 std::vector<double> DiffReal::get_derivs() const
 {
-        std::vector<double> result;
-        result.reserve(derivs.size());
-        for (std::size_t i = 0; i < derivs.size(); i++)
-                result.emplace_back(CGAL::to_double(derivs[i]));
-        return result;
+        return derivs.get_dense(derivs.dimension());
 }
 
 std::vector<double> DiffReal::get_derivs(std::size_t num_derivs) const
 {
-        std::vector<double> result;
-        result.reserve(num_derivs);
-        for (std::size_t i = 0; i < std::min(derivs.size(), num_derivs); i++)
-                result.emplace_back(CGAL::to_double(derivs[i]));
-        while (result.size() < num_derivs)
-                result.emplace_back(0.0);
+        return derivs.get_dense(num_derivs);
+}
+
+bool DiffReal::in_arena() const
+{
+        Arena *arena = Arena::current();
+        if (arena == nullptr)
+                return false;
+
+        if (derivs.in_arena())
+                return true;
+
+#if !defined(DIFFMESH_LAZY_EXACT) && !defined(DIFFMESH_FAST_KERNEL)
+        if (arena->use_for_gmp())
+        {
+                mpq_srcptr q = value.mpq();
+                return arena->owns(mpq_numref(q)->_mp_d) || arena->owns(mpq_denref(q)->_mp_d);
+        }
+#endif
+        return false;
+}
+
+DiffReal DiffReal::detached() const
+{
+        ArenaScope::Suspend suspend;
+        DiffReal result(*this);
+#if !defined(DIFFMESH_LAZY_EXACT) && !defined(DIFFMESH_FAST_KERNEL)
+        result.value = Value(value.mpq());
+#endif
         return result;
 }
 
+std::size_t DiffReal::bit_size() const
+{
+        // lazy values are not evaluated for this
+#if !defined(DIFFMESH_FAST_KERNEL) && !defined(DIFFMESH_LAZY_EXACT)
+        return mpz_sizeinbase(mpq_numref(value.mpq()), 2) + mpz_sizeinbase(mpq_denref(value.mpq()), 2);
+#else
+        return 0;
+#endif
+}
+
+// counts the operation and tracks the size of the exact result
+static inline void count_operation(const DiffReal &x)
+{
+        if (!Stats::is_enabled())
+                return;
+
+        Stats::count(Stats::VALUE_OPS);
+        Stats::record_bits(x.bit_size());
+}
+
 DiffReal DiffReal::operator-() const
 {
         DiffReal result;
         result.value = -value;
-        result.derivs.reserve(derivs.size());
-        for (size_t i = 0; i < derivs.size(); i++)
-                result.derivs.emplace_back(-derivs[i]);
+        count_operation(result);
+        result.derivs = derivs;
+        result.derivs.scale(-1.0);
+        if (node != 0)
+                result.node = Tape::record(node, -1.0, 0, 0.0);
         return result;
 }
 
@@ -80,22 +124,20 @@ DiffReal DiffReal::operator/(const DiffReal &other) const
 DiffReal &DiffReal::operator+=(const DiffReal &other)
 {
         value += other.value;
-        std::size_t min_size = std::min(derivs.size(), other.derivs.size());
-        for (std::size_t i = 0; i < min_size; i++)
-                derivs[i] += other.derivs[i];
-        for (std::size_t i = min_size; i < other.derivs.size(); i++)
-                derivs.emplace_back(other.derivs[i]);
+        count_operation(*this);
+        derivs.axpy(1.0, other.derivs);
+        if ((node | other.node) != 0)
+                node = Tape::record(node, 1.0, other.node, 1.0);
         return *this;
 }
 
 DiffReal &DiffReal::operator-=(const DiffReal &other)
 {
         value -= other.value;
-        std::size_t min_size = std::min(derivs.size(), other.derivs.size());
-        for (std::size_t i = 0; i < min_size; i++)
-                derivs[i] -= other.derivs[i];
-        for (std::size_t i = min_size; i < other.derivs.size(); i++)
-                derivs.emplace_back(-other.derivs[i]);
+        count_operation(*this);
+        derivs.axpy(-1.0, other.derivs);
+        if ((node | other.node) != 0)
+                node = Tape::record(node, 1.0, other.node, -1.0);
         return *this;
 }
 
@@ -104,13 +146,10 @@ DiffReal &DiffReal::operator*=(const DiffReal &other)
         double temp1 = CGAL::to_double(other.value);
         double temp2 = CGAL::to_double(value);
         value *= other.value;
-        std::size_t min_size = std::min(derivs.size(), other.derivs.size());
-        for (std::size_t i = 0; i < derivs.size(); i++)
-                derivs[i] *= temp1;
-        for (std::size_t i = 0; i < min_size; i++)
-                derivs[i] += temp2 * other.derivs[i];
-        for (std::size_t i = min_size; i < other.derivs.size(); i++)
-                derivs.emplace_back(temp2 * other.derivs[i]);
+        count_operation(*this);
+        derivs.scale_axpy(temp1, temp2, other.derivs);
+        if ((node | other.node) != 0)
+                node = Tape::record(node, temp1, other.node, temp2);
         return *this;
 }
 
@@ -119,13 +158,10 @@ DiffReal &DiffReal::operator/=(const DiffReal &other)
         double temp1 = 1.0 / CGAL::to_double(other.value);
         double temp2 = CGAL::to_double(value) * temp1 * temp1;
         value /= other.value;
-        std::size_t min_size = std::min(derivs.size(), other.derivs.size());
-        for (std::size_t i = 0; i < derivs.size(); i++)
-                derivs[i] *= temp1;
-        for (std::size_t i = 0; i < min_size; i++)
-                derivs[i] -= temp2 * other.derivs[i];
-        for (std::size_t i = min_size; i < other.derivs.size(); i++)
-                derivs.emplace_back(-temp2 * other.derivs[i]);
+        count_operation(*this);
+        derivs.scale_axpy(temp1, -temp2, other.derivs);
+        if ((node | other.node) != 0)
+                node = Tape::record(node, temp1, other.node, -temp2);
         return *this;
 }
 
@@ -133,11 +169,12 @@ DiffReal DiffReal::cos() const
 {
         DiffReal result;
         double temp1 = CGAL::to_double(value);
-        result.value = std::cos(temp1);
         double temp2 = -std::sin(temp1);
-        result.derivs.reserve(derivs.size());
-        for (size_t i = 0; i < derivs.size(); i++)
-                result.derivs.emplace_back(derivs[i] * temp2);
+        result.value = std::cos(temp1);
+        result.derivs = derivs;
+        result.derivs.scale(temp2);
+        if (node != 0)
+                result.node = Tape::record(node, temp2, 0, 0.0);
         return result;
 }
 
@@ -145,11 +182,12 @@ DiffReal DiffReal::sin() const
 {
         DiffReal result;
         double temp1 = CGAL::to_double(value);
-        result.value = std::sin(temp1);
         double temp2 = std::cos(temp1);
-        result.derivs.reserve(derivs.size());
-        for (size_t i = 0; i < derivs.size(); i++)
-                result.derivs.emplace_back(derivs[i] * temp2);
+        result.value = std::sin(temp1);
+        result.derivs = derivs;
+        result.derivs.scale(temp2);
+        if (node != 0)
+                result.node = Tape::record(node, temp2, 0, 0.0);
         return result;
 }
 
@@ -160,6 +198,76 @@ std::string DiffReal::repr() const
         return str.str();
 }
 
+DiffReal operator-(DiffReal &&x)
+{
+        x.value = -x.value;
+        count_operation(x);
+        x.derivs.scale(-1.0);
+        if (x.node != 0)
+                x.node = Tape::record(x.node, -1.0, 0, 0.0);
+        return std::move(x);
+}
+
+DiffReal operator+(DiffReal &&left, const DiffReal &right)
+{
+        left += right;
+        return std::move(left);
+}
+
+DiffReal operator+(const DiffReal &left, DiffReal &&right)
+{
+        right += left;
+        return std::move(right);
+}
+
+DiffReal operator+(DiffReal &&left, DiffReal &&right)
+{
+        left += right;
+        return std::move(left);
+}
+
+DiffReal operator-(DiffReal &&left, const DiffReal &right)
+{
+        left -= right;
+        return std::move(left);
+}
+
+DiffReal operator-(DiffReal &&left, DiffReal &&right)
+{
+        left -= right;
+        return std::move(left);
+}
+
+DiffReal operator*(DiffReal &&left, const DiffReal &right)
+{
+        left *= right;
+        return std::move(left);
+}
+
+DiffReal operator*(const DiffReal &left, DiffReal &&right)
+{
+        right *= left;
+        return std::move(right);
+}
+
+DiffReal operator*(DiffReal &&left, DiffReal &&right)
+{
+        left *= right;
+        return std::move(left);
+}
+
+DiffReal operator/(DiffReal &&left, const DiffReal &right)
+{
+        left /= right;
+        return std::move(left);
+}
+
+DiffReal operator/(DiffReal &&left, DiffReal &&right)
+{
+        left /= right;
+        return std::move(left);
+}
+
 DiffReal operator*(double left, const DiffReal &right)
 {
         return DiffReal(left) * right;
@@ -167,7 +275,7 @@ DiffReal operator*(double left, const DiffReal &right)
 
 DiffReal operator/(double left, const DiffReal &right)
 {
-        return DiffReal(left) * right;
+        return DiffReal(left) / right;
 }
 
 std::ostream &operator<<(std::ostream &out, const DiffReal &x)
@@ -181,3 +289,215 @@ std::istream &operator>>(std::istream &in, DiffReal &x)
         in >> x.value;
         return in;
 }
+
+#ifdef DIFFMESH_FAST_KERNEL
+// error bounds of the plain double evaluations, from Shewchuk's predicates
+static const double EPSILON = 1.1102230246251565e-16;
+static const double ORIENTATION_BOUND = (3.0 + 16.0 * EPSILON) * EPSILON;
+static const double INCIRCLE_BOUND = (10.0 + 96.0 * EPSILON) * EPSILON;
+
+CGAL::Orientation CGAL::fast_orientation(double px, double py, double qx, double qy, double rx, double ry)
+{
+        double left = (px - rx) * (qy - ry);
+        double right = (py - ry) * (qx - rx);
+        double det = left - right;
+        if (std::abs(det) > ORIENTATION_BOUND * (std::abs(left) + std::abs(right)))
+                return det > 0.0 ? CGAL::COUNTERCLOCKWISE : CGAL::CLOCKWISE;
+
+        Stats::count(Stats::EXACT_PREDICATES);
+        Gmpq ax = Gmpq(px) - Gmpq(rx), ay = Gmpq(py) - Gmpq(ry);
+        Gmpq bx = Gmpq(qx) - Gmpq(rx), by = Gmpq(qy) - Gmpq(ry);
+        return static_cast<CGAL::Orientation>(CGAL::sign(Gmpq(ax * by - ay * bx)));
+}
+
+CGAL::Oriented_side CGAL::fast_incircle(double px, double py, double qx, double qy,
+                                        double rx, double ry, double tx, double ty)
+{
+        double adx = px - tx, ady = py - ty;
+        double bdx = qx - tx, bdy = qy - ty;
+        double cdx = rx - tx, cdy = ry - ty;
+
+        double bdxcdy = bdx * cdy, cdxbdy = cdx * bdy;
+        double cdxady = cdx * ady, adxcdy = adx * cdy;
+        double adxbdy = adx * bdy, bdxady = bdx * ady;
+        double alift = adx * adx + ady * ady;
+        double blift = bdx * bdx + bdy * bdy;
+        double clift = cdx * cdx + cdy * cdy;
+
+        double det = alift * (bdxcdy - cdxbdy) + blift * (cdxady - adxcdy) + clift * (adxbdy - bdxady);
+        double permanent = (std::abs(bdxcdy) + std::abs(cdxbdy)) * alift +
+                           (std::abs(cdxady) + std::abs(adxcdy)) * blift +
+                           (std::abs(adxbdy) + std::abs(bdxady)) * clift;
+        if (std::abs(det) > INCIRCLE_BOUND * permanent)
+                return det > 0.0 ? CGAL::ON_POSITIVE_SIDE : CGAL::ON_NEGATIVE_SIDE;
+
+        Stats::count(Stats::EXACT_PREDICATES);
+        Gmpq ax = Gmpq(px) - Gmpq(tx), ay = Gmpq(py) - Gmpq(ty);
+        Gmpq bx = Gmpq(qx) - Gmpq(tx), by = Gmpq(qy) - Gmpq(ty);
+        Gmpq cx = Gmpq(rx) - Gmpq(tx), cy = Gmpq(ry) - Gmpq(ty);
+        Gmpq exact = Gmpq(ax * ax + ay * ay) * Gmpq(bx * cy - cx * by) +
+                     Gmpq(bx * bx + by * by) * Gmpq(cx * ay - ax * cy) +
+                     Gmpq(cx * cx + cy * cy) * Gmpq(ax * by - bx * ay);
+        return static_cast<CGAL::Oriented_side>(CGAL::sign(exact));
+}
+
+// the CGAL predicate on intervals of the double inputs, which either decides
+// it or throws when a sign is uncertain, then on exact rationals
+template <typename Result, typename Filter, typename Exact>
+static Result fast_predicate(Filter filter, Exact exact)
+{
+        {
+                CGAL::Protect_FPU_rounding<true> protect;
+                try
+                {
+                        return filter();
+                }
+                catch (CGAL::Uncertain_conversion_exception &)
+                {
+                }
+        }
+
+        Stats::count(Stats::EXACT_PREDICATES);
+        return exact();
+}
+
+#define FAST_PREDICATE(RESULT, CALL)                                                                  \
+        fast_predicate<RESULT>([&]() -> RESULT { typedef CGAL::Interval_nt<false> FT; return CALL; }, \
+                               [&]() -> RESULT { typedef CGAL::Gmpq FT; return CALL; })
+
+namespace CGAL
+{
+template <>
+Comparison_result compare_y_at_xC2<DiffReal>(const DiffReal &px, const DiffReal &py,
+                                             const DiffReal &la, const DiffReal &lb,
+                                             const DiffReal &lc)
+{
+        return FAST_PREDICATE(Comparison_result, compare_y_at_xC2(FT(px.value), FT(py.value), FT(la.value), FT(lb.value),
+                                                                  FT(lc.value)));
+}
+
+template <>
+Comparison_result compare_y_at_xC2<DiffReal>(const DiffReal &px, const DiffReal &py,
+                                             const DiffReal &ssx, const DiffReal &ssy,
+                                             const DiffReal &stx, const DiffReal &sty)
+{
+        return FAST_PREDICATE(Comparison_result, compare_y_at_xC2(FT(px.value), FT(py.value), FT(ssx.value), FT(ssy.value),
+                                                                  FT(stx.value), FT(sty.value)));
+}
+
+template <>
+Comparison_result compare_slopesC2<DiffReal>(const DiffReal &l1a, const DiffReal &l1b,
+                                             const DiffReal &l2a, const DiffReal &l2b)
+{
+        return FAST_PREDICATE(Comparison_result, compare_slopesC2(FT(l1a.value), FT(l1b.value), FT(l2a.value), FT(l2b.value)));
+}
+
+template <>
+Comparison_result compare_slopesC2<DiffReal>(const DiffReal &s1sx, const DiffReal &s1sy,
+                                             const DiffReal &s1tx, const DiffReal &s1ty,
+                                             const DiffReal &s2sx, const DiffReal &s2sy,
+                                             const DiffReal &s2tx, const DiffReal &s2ty)
+{
+        return FAST_PREDICATE(Comparison_result, compare_slopesC2(FT(s1sx.value), FT(s1sy.value), FT(s1tx.value), FT(s1ty.value),
+                                                                  FT(s2sx.value), FT(s2sy.value), FT(s2tx.value), FT(s2ty.value)));
+}
+
+template <>
+Comparison_result compare_angle_with_x_axisC2<DiffReal>(const DiffReal &dx1, const DiffReal &dy1,
+                                                        const DiffReal &dx2, const DiffReal &dy2)
+{
+        return FAST_PREDICATE(Comparison_result, compare_angle_with_x_axisC2(FT(dx1.value), FT(dy1.value), FT(dx2.value), FT(dy2.value)));
+}
+
+template <>
+Comparison_result cmp_dist_to_pointC2<DiffReal>(const DiffReal &px, const DiffReal &py,
+                                                const DiffReal &qx, const DiffReal &qy,
+                                                const DiffReal &rx, const DiffReal &ry)
+{
+        return FAST_PREDICATE(Comparison_result, cmp_dist_to_pointC2(FT(px.value), FT(py.value), FT(qx.value), FT(qy.value),
+                                                                     FT(rx.value), FT(ry.value)));
+}
+
+template <>
+Comparison_result cmp_signed_dist_to_lineC2<DiffReal>(const DiffReal &px, const DiffReal &py,
+                                                      const DiffReal &qx, const DiffReal &qy,
+                                                      const DiffReal &rx, const DiffReal &ry,
+                                                      const DiffReal &sx, const DiffReal &sy)
+{
+        return FAST_PREDICATE(Comparison_result, cmp_signed_dist_to_lineC2(FT(px.value), FT(py.value), FT(qx.value), FT(qy.value),
+                                                                           FT(rx.value), FT(ry.value), FT(sx.value), FT(sy.value)));
+}
+
+template <>
+bool parallelC2<DiffReal>(const DiffReal &l1a, const DiffReal &l1b,
+                          const DiffReal &l2a, const DiffReal &l2b)
+{
+        return FAST_PREDICATE(bool, parallelC2(FT(l1a.value), FT(l1b.value), FT(l2a.value), FT(l2b.value)));
+}
+
+template <>
+bool parallelC2<DiffReal>(const DiffReal &s1sx, const DiffReal &s1sy,
+                          const DiffReal &s1tx, const DiffReal &s1ty,
+                          const DiffReal &s2sx, const DiffReal &s2sy,
+                          const DiffReal &s2tx, const DiffReal &s2ty)
+{
+        return FAST_PREDICATE(bool, parallelC2(FT(s1sx.value), FT(s1sy.value), FT(s1tx.value), FT(s1ty.value),
+                                               FT(s2sx.value), FT(s2sy.value), FT(s2tx.value), FT(s2ty.value)));
+}
+
+template <>
+bool equal_lineC2<DiffReal>(const DiffReal &l1a, const DiffReal &l1b,
+                            const DiffReal &l1c, const DiffReal &l2a,
+                            const DiffReal &l2b, const DiffReal &l2c)
+{
+        return FAST_PREDICATE(bool, equal_lineC2(FT(l1a.value), FT(l1b.value), FT(l1c.value), FT(l2a.value),
+                                                 FT(l2b.value), FT(l2c.value)));
+}
+
+template <>
+bool equal_directionC2<DiffReal>(const DiffReal &dx1, const DiffReal &dy1,
+                                 const DiffReal &dx2, const DiffReal &dy2)
+{
+        return FAST_PREDICATE(bool, equal_directionC2(FT(dx1.value), FT(dy1.value), FT(dx2.value), FT(dy2.value)));
+}
+
+template <>
+Oriented_side side_of_oriented_lineC2<DiffReal>(const DiffReal &a, const DiffReal &b,
+                                                const DiffReal &c, const DiffReal &x,
+                                                const DiffReal &y)
+{
+        return FAST_PREDICATE(Oriented_side, side_of_oriented_lineC2(FT(a.value), FT(b.value), FT(c.value), FT(x.value),
+                                                                     FT(y.value)));
+}
+
+template <>
+Bounded_side side_of_bounded_circleC2<DiffReal>(const DiffReal &px, const DiffReal &py,
+                                                const DiffReal &qx, const DiffReal &qy,
+                                                const DiffReal &tx, const DiffReal &ty)
+{
+        return FAST_PREDICATE(Bounded_side, side_of_bounded_circleC2(FT(px.value), FT(py.value), FT(qx.value), FT(qy.value),
+                                                                     FT(tx.value), FT(ty.value)));
+}
+
+template <>
+Bounded_side side_of_bounded_circleC2<DiffReal>(const DiffReal &px, const DiffReal &py,
+                                                const DiffReal &qx, const DiffReal &qy,
+                                                const DiffReal &rx, const DiffReal &ry,
+                                                const DiffReal &tx, const DiffReal &ty)
+{
+        return FAST_PREDICATE(Bounded_side, side_of_bounded_circleC2(FT(px.value), FT(py.value), FT(qx.value), FT(qy.value),
+                                                                     FT(rx.value), FT(ry.value), FT(tx.value), FT(ty.value)));
+}
+
+template <>
+Angle angleC2<DiffReal>(const DiffReal &px, const DiffReal &py,
+                        const DiffReal &qx, const DiffReal &qy,
+                        const DiffReal &rx, const DiffReal &ry)
+{
+        return FAST_PREDICATE(Angle, angleC2(FT(px.value), FT(py.value), FT(qx.value), FT(qy.value),
+                                             FT(rx.value), FT(ry.value)));
+}
+}
+
+#undef FAST_PREDICATE
+#endif
@@ -20,6 +20,11 @@
 #ifndef DIFFREAL_HPP
 #define DIFFREAL_HPP
 
+#include "derivs.hpp"
+#include "stats.hpp"
+#include "tape.hpp"
+
+#include <utility>
 #include <vector>
 
 #include <CGAL/Gmpq.h>
@@ -27,36 +32,98 @@
 #include <CGAL/Coercion_traits.h>
 #include <CGAL/Cartesian.h>
 
+#ifdef DIFFMESH_LAZY_EXACT
+#include <CGAL/Lazy_exact_nt.h>
+#endif
+
+#ifdef DIFFMESH_FAST_KERNEL
+#include <CGAL/predicates/kernel_ftC2.h>
+#include <CGAL/Interval_nt.h>
+#endif
+
 class DiffReal
 {
 public:
+#ifdef DIFFMESH_FAST_KERNEL
+        // rounded constructions, the predicates below are evaluated exactly
+        // on the rounded coordinates
+        typedef double Value;
+#elif defined(DIFFMESH_LAZY_EXACT)
+        // keeps a double interval next to a lazily evaluated exact rational,
+        // signs and comparisons only fall back to Gmpq when the filter fails
+        typedef CGAL::Lazy_exact_nt<CGAL::Gmpq> Value;
+#else
         typedef CGAL::Gmpq Value;
+#endif
 
         Value value;
-        std::vector<double> derivs;
+        Derivs derivs;
+        Tape::Node node;
 
-        DiffReal() {}
-        DiffReal(double value) : value(value) {}
-        DiffReal(double value, std::vector<double> derivs) : value(value), derivs(derivs) {}
-        DiffReal(const DiffReal &other) : value(other.value), derivs(other.derivs) {}
+        DiffReal() : node(0) {}
+        DiffReal(double value) : value(value), node(0) {}
+        DiffReal(double value, std::vector<double> derivs) : value(value), derivs(derivs), node(0) {}
+        DiffReal(double value, Derivs &&derivs) : value(value), derivs(std::move(derivs)), node(0) {}
+        DiffReal(double value, std::vector<std::size_t> indices, std::vector<double> derivs)
+            : value(value), derivs(indices, derivs), node(0) {}
+        DiffReal(const DiffReal &other) : value(other.value), derivs(other.derivs), node(other.node) {}
+        DiffReal(DiffReal &&other) noexcept
+            : value(std::move(other.value)), derivs(std::move(other.derivs)), node(other.node) {}
 
         DiffReal &operator=(const DiffReal &other)
         {
                 value = other.value;
                 derivs = other.derivs;
+                node = other.node;
+                return *this;
+        }
+
+        DiffReal &operator=(DiffReal &&other) noexcept
+        {
+                value = std::move(other.value);
+                derivs = std::move(other.derivs);
+                node = other.node;
                 return *this;
         }
 
         double get_value() const { return CGAL::to_double(value); }
         std::vector<double> get_derivs() const;
         std::vector<double> get_derivs(std::size_t num_derivs) const;
+        bool is_sparse() const { return derivs.is_sparse(); }
+
+        // numerator plus denominator bits, 0 unless the value is a plain Gmpq
+        std::size_t bit_size() const;
+
+        // whether some storage lives in the arena of the current thread
+        bool in_arena() const;
+
+        // evaluates a lazy exact value and drops its DAG, so threads can read
+        // it at the same time, a no-op with the other value types
+        void make_exact() const
+        {
+#ifdef DIFFMESH_LAZY_EXACT
+                value.exact();
+#endif
+        }
+
+        // copy whose storage is on the heap, safe to keep after the arena scope
+        DiffReal detached() const;
+
+        // sign tests of exact values are counted as predicate evaluations,
+        // the fast kernel counts its exact fallbacks instead
+        static void count_predicate()
+        {
+#ifndef DIFFMESH_FAST_KERNEL
+                Stats::count(Stats::EXACT_PREDICATES);
+#endif
+        }
 
-        bool operator==(const DiffReal &other) const { return value == other.value; }
-        bool operator!=(const DiffReal &other) const { return value != other.value; }
-        bool operator<(const DiffReal &other) const { return value < other.value; }
-        bool operator<=(const DiffReal &other) const { return value <= other.value; }
-        bool operator>(const DiffReal &other) const { return value > other.value; }
-        bool operator>=(const DiffReal &other) const { return value >= other.value; }
+        bool operator==(const DiffReal &other) const { count_predicate(); return value == other.value; }
+        bool operator!=(const DiffReal &other) const { count_predicate(); return value != other.value; }
+        bool operator<(const DiffReal &other) const { count_predicate(); return value < other.value; }
+        bool operator<=(const DiffReal &other) const { count_predicate(); return value <= other.value; }
+        bool operator>(const DiffReal &other) const { count_predicate(); return value > other.value; }
+        bool operator>=(const DiffReal &other) const { count_predicate(); return value >= other.value; }
 
         DiffReal operator-() const;
         DiffReal operator+() const { return *this; }
@@ -77,6 +144,20 @@ public:
         std::string repr() const;
 };
 
+// Temporaries are updated in place, so chains like a * b - c * d allocate
+// a single result instead of one copy per operator.
+DiffReal operator-(DiffReal &&x);
+DiffReal operator+(DiffReal &&left, const DiffReal &right);
+DiffReal operator+(const DiffReal &left, DiffReal &&right);
+DiffReal operator+(DiffReal &&left, DiffReal &&right);
+DiffReal operator-(DiffReal &&left, const DiffReal &right);
+DiffReal operator-(DiffReal &&left, DiffReal &&right);
+DiffReal operator*(DiffReal &&left, const DiffReal &right);
+DiffReal operator*(const DiffReal &left, DiffReal &&right);
+DiffReal operator*(DiffReal &&left, DiffReal &&right);
+DiffReal operator/(DiffReal &&left, const DiffReal &right);
+DiffReal operator/(DiffReal &&left, DiffReal &&right);
+
 DiffReal operator*(double left, const DiffReal &right);
 DiffReal operator/(double left, const DiffReal &right);
 
@@ -92,8 +173,13 @@ namespace CGAL
         class Algebraic_structure_traits<DiffReal> : public Algebraic_structure_traits_base<DiffReal, Field_tag>
         {
         public:
+#ifdef DIFFMESH_FAST_KERNEL
+                typedef Tag_false Is_exact;
+                typedef Tag_true Is_numerical_sensitive;
+#else
                 typedef Tag_true Is_exact;
                 typedef Tag_false Is_numerical_sensitive;
+#endif
 
                 class Is_zero
                     : public CGAL::cpp98::unary_function<Type, bool>
@@ -101,6 +187,7 @@ namespace CGAL
                 public:
                         inline bool operator()(const Type &x) const
                         {
+                                DiffReal::count_predicate();
                                 return CGAL::is_zero(x.value);
                         }
                 };
@@ -145,6 +232,7 @@ namespace CGAL
                 public:
                         inline bool operator()(const Type &x) const
                         {
+                                DiffReal::count_predicate();
                                 return CGAL::is_positive(x.value);
                         }
                 };
@@ -155,6 +243,7 @@ namespace CGAL
                 public:
                         inline bool operator()(const Type &x) const
                         {
+                                DiffReal::count_predicate();
                                 return CGAL::is_negative(x.value);
                         }
                 };
@@ -165,6 +254,7 @@ namespace CGAL
                 public:
                         inline CGAL::Sign operator()(const Type &x) const
                         {
+                                DiffReal::count_predicate();
                                 return CGAL::sign(x.value);
                         }
                 };
@@ -187,6 +277,112 @@ namespace CGAL
                         };
                 };
         };
+
+#ifdef DIFFMESH_FAST_KERNEL
+        // floating point filter with an exact fallback on the double inputs,
+        // so the triangulations and arrangements see consistent signs
+        Orientation fast_orientation(double px, double py, double qx, double qy, double rx, double ry);
+        Oriented_side fast_incircle(double px, double py, double qx, double qy,
+                                    double rx, double ry, double tx, double ty);
+
+        template <>
+        inline Same_uncertainty_nt<Orientation, DiffReal>::type
+        orientationC2<DiffReal>(const DiffReal &px, const DiffReal &py,
+                                const DiffReal &qx, const DiffReal &qy,
+                                const DiffReal &rx, const DiffReal &ry)
+        {
+                return fast_orientation(px.value, py.value, qx.value, qy.value, rx.value, ry.value);
+        }
+
+        template <>
+        inline Same_uncertainty_nt<Oriented_side, DiffReal>::type
+        side_of_oriented_circleC2<DiffReal>(const DiffReal &px, const DiffReal &py,
+                                            const DiffReal &qx, const DiffReal &qy,
+                                            const DiffReal &rx, const DiffReal &ry,
+                                            const DiffReal &tx, const DiffReal &ty)
+        {
+                return fast_incircle(px.value, py.value, qx.value, qy.value,
+                                     rx.value, ry.value, tx.value, ty.value);
+        }
+
+        // the other predicates that do arithmetic on the coordinates, among
+        // them the sweep and arrangement predicates behind Polygon_set_2, are
+        // evaluated on intervals with an exact fallback in diffreal.cpp
+        template <>
+        Comparison_result compare_y_at_xC2<DiffReal>(const DiffReal &px, const DiffReal &py,
+                                                     const DiffReal &la, const DiffReal &lb,
+                                                     const DiffReal &lc);
+
+        template <>
+        Comparison_result compare_y_at_xC2<DiffReal>(const DiffReal &px, const DiffReal &py,
+                                                     const DiffReal &ssx, const DiffReal &ssy,
+                                                     const DiffReal &stx, const DiffReal &sty);
+
+        template <>
+        Comparison_result compare_slopesC2<DiffReal>(const DiffReal &l1a, const DiffReal &l1b,
+                                                     const DiffReal &l2a, const DiffReal &l2b);
+
+        template <>
+        Comparison_result compare_slopesC2<DiffReal>(const DiffReal &s1sx, const DiffReal &s1sy,
+                                                     const DiffReal &s1tx, const DiffReal &s1ty,
+                                                     const DiffReal &s2sx, const DiffReal &s2sy,
+                                                     const DiffReal &s2tx, const DiffReal &s2ty);
+
+        template <>
+        Comparison_result compare_angle_with_x_axisC2<DiffReal>(const DiffReal &dx1, const DiffReal &dy1,
+                                                                const DiffReal &dx2, const DiffReal &dy2);
+
+        template <>
+        Comparison_result cmp_dist_to_pointC2<DiffReal>(const DiffReal &px, const DiffReal &py,
+                                                        const DiffReal &qx, const DiffReal &qy,
+                                                        const DiffReal &rx, const DiffReal &ry);
+
+        template <>
+        Comparison_result cmp_signed_dist_to_lineC2<DiffReal>(const DiffReal &px, const DiffReal &py,
+                                                              const DiffReal &qx, const DiffReal &qy,
+                                                              const DiffReal &rx, const DiffReal &ry,
+                                                              const DiffReal &sx, const DiffReal &sy);
+
+        template <>
+        bool parallelC2<DiffReal>(const DiffReal &l1a, const DiffReal &l1b,
+                                  const DiffReal &l2a, const DiffReal &l2b);
+
+        template <>
+        bool parallelC2<DiffReal>(const DiffReal &s1sx, const DiffReal &s1sy,
+                                  const DiffReal &s1tx, const DiffReal &s1ty,
+                                  const DiffReal &s2sx, const DiffReal &s2sy,
+                                  const DiffReal &s2tx, const DiffReal &s2ty);
+
+        template <>
+        bool equal_lineC2<DiffReal>(const DiffReal &l1a, const DiffReal &l1b,
+                                    const DiffReal &l1c, const DiffReal &l2a,
+                                    const DiffReal &l2b, const DiffReal &l2c);
+
+        template <>
+        bool equal_directionC2<DiffReal>(const DiffReal &dx1, const DiffReal &dy1,
+                                         const DiffReal &dx2, const DiffReal &dy2);
+
+        template <>
+        Oriented_side side_of_oriented_lineC2<DiffReal>(const DiffReal &a, const DiffReal &b,
+                                                        const DiffReal &c, const DiffReal &x,
+                                                        const DiffReal &y);
+
+        template <>
+        Bounded_side side_of_bounded_circleC2<DiffReal>(const DiffReal &px, const DiffReal &py,
+                                                        const DiffReal &qx, const DiffReal &qy,
+                                                        const DiffReal &tx, const DiffReal &ty);
+
+        template <>
+        Bounded_side side_of_bounded_circleC2<DiffReal>(const DiffReal &px, const DiffReal &py,
+                                                        const DiffReal &qx, const DiffReal &qy,
+                                                        const DiffReal &rx, const DiffReal &ry,
+                                                        const DiffReal &tx, const DiffReal &ty);
+
+        template <>
+        Angle angleC2<DiffReal>(const DiffReal &px, const DiffReal &py,
+                                const DiffReal &qx, const DiffReal &qy,
+                                const DiffReal &rx, const DiffReal &ry);
+#endif
 }
 
 typedef CGAL::Cartesian<DiffReal> Kernel;
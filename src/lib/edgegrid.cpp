@@ -0,0 +1,129 @@
+/*
+ * Copyright 2023 Miklos Maroti.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "edgegrid.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+EdgeGrid::EdgeGrid(const std::vector<Segment> &segments)
+    : d_segments(segments),
+      d_xmin(std::numeric_limits<double>::infinity()),
+      d_ymin(std::numeric_limits<double>::infinity()),
+      d_xmax(-std::numeric_limits<double>::infinity()),
+      d_ymax(-std::numeric_limits<double>::infinity())
+{
+        for (auto &s : d_segments)
+        {
+                d_xmin = std::min({d_xmin, s[0], s[2]});
+                d_ymin = std::min({d_ymin, s[1], s[3]});
+                d_xmax = std::max({d_xmax, s[0], s[2]});
+                d_ymax = std::max({d_ymax, s[1], s[3]});
+        }
+
+        // the coordinates are within half an ulp of the exact values, and the
+        // orientation test loses a few more, so this leaves a wide margin
+        double scale = 0.0;
+        if (!d_segments.empty())
+                scale = std::max({std::fabs(d_xmin), std::fabs(d_ymin), std::fabs(d_xmax), std::fabs(d_ymax)});
+        d_tolerance = 1024.0 * std::numeric_limits<double>::epsilon() * std::max(scale, 1e-300);
+
+        std::size_t num_bands = std::max<std::size_t>(1, d_segments.size() / 2);
+        d_band_height = (d_ymax - d_ymin) / num_bands;
+        if (!(d_band_height > 0.0))
+        {
+                num_bands = 1;
+                d_band_height = 1.0;
+        }
+        d_num_bands = num_bands;
+
+        // counting sort of the segments into every band they overlap
+        d_band_start.assign(num_bands + 2, 0);
+        for (auto &s : d_segments)
+        {
+                std::size_t b0 = band(std::min(s[1], s[3]) - d_tolerance);
+                std::size_t b1 = band(std::max(s[1], s[3]) + d_tolerance);
+                for (std::size_t b = b0; b <= b1; b++)
+                        d_band_start[b + 2] += 1;
+        }
+        for (std::size_t b = 2; b < d_band_start.size(); b++)
+                d_band_start[b] += d_band_start[b - 1];
+
+        d_band_segments.resize(d_band_start.back());
+        for (std::size_t i = 0; i < d_segments.size(); i++)
+        {
+                auto &s = d_segments[i];
+                std::size_t b0 = band(std::min(s[1], s[3]) - d_tolerance);
+                std::size_t b1 = band(std::max(s[1], s[3]) + d_tolerance);
+                for (std::size_t b = b0; b <= b1; b++)
+                        d_band_segments[d_band_start[b + 1]++] = i;
+        }
+        d_band_start.pop_back();
+}
+
+std::size_t EdgeGrid::band(double y) const
+{
+        double b = std::floor((y - d_ymin) / d_band_height);
+        if (!(b > 0.0))
+                return 0;
+        return std::min(static_cast<std::size_t>(b), d_num_bands - 1);
+}
+
+int EdgeGrid::classify(double x, double y) const
+{
+        double tol = d_tolerance;
+        if (!(x >= d_xmin - tol && x <= d_xmax + tol && y >= d_ymin - tol && y <= d_ymax + tol))
+                return OUTSIDE;
+
+        std::size_t b = band(y);
+        bool inside = false;
+        for (std::size_t k = d_band_start[b]; k < d_band_start[b + 1]; k++)
+        {
+                const Segment &s = d_segments[d_band_segments[k]];
+                double x0 = s[0], y0 = s[1], x1 = s[2], y1 = s[3];
+
+                if (y < std::min(y0, y1) - tol || y > std::max(y0, y1) + tol)
+                        continue;
+
+                // close to a vertex, or to the line of the segment within its extent
+                if (std::fabs(y - y0) <= tol || std::fabs(y - y1) <= tol)
+                {
+                        if (x >= std::min(x0, x1) - tol && x <= std::max(x0, x1) + tol)
+                                return UNDECIDED;
+                }
+
+                double dx = x1 - x0;
+                double dy = y1 - y0;
+                double det = dx * (y - y0) - dy * (x - x0);
+                double len = std::sqrt(dx * dx + dy * dy);
+                if (std::fabs(det) <= tol * len &&
+                    x >= std::min(x0, x1) - tol && x <= std::max(x0, x1) + tol)
+                        return UNDECIDED;
+
+                if ((y0 <= y) == (y1 <= y))
+                        continue;
+
+                // the vertex cases are excluded above, so y is strictly inside
+                if ((det > 0.0) == (dy > 0.0))
+                        inside = !inside;
+        }
+
+        return inside ? INSIDE : OUTSIDE;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2023 Miklos Maroti.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef EDGEGRID_HPP
+#define EDGEGRID_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Point location on the double approximations of polygon edges. The edges
+ * are bucketed into horizontal bands, and a point is classified by counting
+ * the crossings of a ray towards positive x with the edges of its band.
+ * Points that lie too close to an edge or to a vertex for doubles to decide
+ * are reported as undecided, and must be classified exactly by the caller.
+ */
+class EdgeGrid
+{
+public:
+        typedef std::array<double, 4> Segment; // x0, y0, x1, y1
+
+        static const int INSIDE = 1;
+        static const int OUTSIDE = -1;
+        static const int UNDECIDED = 0;
+
+        explicit EdgeGrid(const std::vector<Segment> &segments);
+
+        int classify(double x, double y) const;
+
+        std::size_t num_bands() const { return d_num_bands; }
+
+protected:
+        std::size_t band(double y) const;
+
+        std::vector<Segment> d_segments;
+        std::vector<std::size_t> d_band_start;
+        std::vector<std::uint32_t> d_band_segments;
+        std::size_t d_num_bands;
+        double d_xmin, d_ymin, d_xmax, d_ymax;
+        double d_band_height;
+        double d_tolerance;
+};
+
+#endif // EDGEGRID_HPP
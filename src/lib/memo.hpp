@@ -0,0 +1,156 @@
+/*
+ * Copyright 2023 Miklos Maroti.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef MEMO_HPP
+#define MEMO_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+
+struct MemoStats
+{
+        std::size_t hits;
+        std::size_t misses;
+        std::size_t size;
+        std::size_t capacity;
+};
+
+/*
+ * Thread safe least recently used cache keyed by content hashes. Every entry
+ * also keeps the key material the hash was computed from, so a colliding
+ * hash is a miss and not a wrong result. A zero capacity disables it, then
+ * lookups miss without being counted.
+ */
+template <typename Value>
+class MemoCache
+{
+public:
+        explicit MemoCache(std::size_t capacity = 0) : d_capacity(capacity), d_hits(0), d_misses(0) {}
+
+        bool is_enabled() const
+        {
+                std::lock_guard<std::mutex> lock(d_mutex);
+                return d_capacity > 0;
+        }
+
+        void set_capacity(std::size_t capacity)
+        {
+                std::lock_guard<std::mutex> lock(d_mutex);
+                d_capacity = capacity;
+                shrink();
+        }
+
+        // the entry is also checked with verify, outside the lock, which
+        // can compare the parts of the key that are not in the material
+        template <typename Verify>
+        bool find(std::uint64_t key, const std::string &material, Value &value, Verify verify)
+        {
+                bool found = false;
+                {
+                        std::lock_guard<std::mutex> lock(d_mutex);
+                        if (d_capacity == 0)
+                                return false;
+
+                        auto it = d_index.find(key);
+                        if (it != d_index.end() && std::get<1>(*it->second) == material)
+                        {
+                                d_entries.splice(d_entries.begin(), d_entries, it->second);
+                                value = std::get<2>(*it->second);
+                                found = true;
+                        }
+                }
+
+                bool hit = found && verify(value);
+                std::lock_guard<std::mutex> lock(d_mutex);
+                if (hit)
+                        d_hits += 1;
+                else
+                        d_misses += 1;
+                return hit;
+        }
+
+        // a colliding entry with different material is replaced
+        void insert(std::uint64_t key, const std::string &material, const Value &value)
+        {
+                std::lock_guard<std::mutex> lock(d_mutex);
+                if (d_capacity == 0)
+                        return;
+
+                auto it = d_index.find(key);
+                if (it != d_index.end())
+                {
+                        std::get<1>(*it->second) = material;
+                        std::get<2>(*it->second) = value;
+                        d_entries.splice(d_entries.begin(), d_entries, it->second);
+                        return;
+                }
+
+                d_entries.emplace_front(key, material, value);
+                d_index[key] = d_entries.begin();
+                shrink();
+        }
+
+        void clear()
+        {
+                std::lock_guard<std::mutex> lock(d_mutex);
+                d_entries.clear();
+                d_index.clear();
+        }
+
+        MemoStats get_stats() const
+        {
+                std::lock_guard<std::mutex> lock(d_mutex);
+                return {d_hits, d_misses, d_entries.size(), d_capacity};
+        }
+
+        void reset_stats()
+        {
+                std::lock_guard<std::mutex> lock(d_mutex);
+                d_hits = 0;
+                d_misses = 0;
+        }
+
+protected:
+        typedef std::list<std::tuple<std::uint64_t, std::string, Value>> Entries;
+
+        void shrink()
+        {
+                while (d_entries.size() > d_capacity)
+                {
+                        d_index.erase(std::get<0>(d_entries.back()));
+                        d_entries.pop_back();
+                }
+        }
+
+        mutable std::mutex d_mutex;
+        std::size_t d_capacity;
+        std::size_t d_hits;
+        std::size_t d_misses;
+        Entries d_entries;
+        std::unordered_map<std::uint64_t, typename Entries::iterator> d_index;
+};
+
+#endif // MEMO_HPP
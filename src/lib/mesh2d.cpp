@@ -18,54 +18,622 @@
  */
 
 #include "mesh2d.hpp"
+#include "threadpool.hpp"
+#include "meshfile.hpp"
+#include "meshwriter.hpp"
+#include "stats.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <map>
 #include <CGAL/Triangulation_conformer_2.h>
-#include <CGAL/lloyd_optimize_mesh_2.h>
 
-Mesh2d::Mesh2d(const Object2d &object)
+Mesh2d::Mesh2d(const Object2d &object) : d_object(object), d_refined(false), d_strip(false)
 {
-        const std::vector<Object2d::Polygon_with_holes_2> &components = object.components;
-        for (auto &c : components)
+        triangulate();
+}
+
+void Mesh2d::triangulate()
+{
+        StatsScope stats("mesh.triangulate");
+        ArenaScope scope;
+        DetachGuard guard(*this, scope);
+        auto start = std::chrono::steady_clock::now();
+
+        // all rings in one batch, so the points are spatially sorted before insertion
+        std::vector<Point_2> points;
+        std::vector<std::pair<std::size_t, std::size_t>> indices;
+        auto add = [&points, &indices](const Object2d::Polygon_2 &polygon)
         {
-                auto &p = c.outer_boundary();
-                triangulation.insert_constraint(p.vertices_begin(), p.vertices_end(), true);
-                for (auto &p : c.holes())
-                        triangulation.insert_constraint(p.vertices_begin(), p.vertices_end(), true);
-        }
+                std::size_t first = points.size();
+                std::size_t size = polygon.container().size();
+                for (std::size_t i = 0; i < size; i++)
+                {
+                        points.push_back(polygon.container()[i]);
+                        indices.emplace_back(first + i, first + (i + 1) % size);
+                }
+        };
 
-        for (auto &f : triangulation.finite_face_handles())
+        for (auto &c : d_object.components())
         {
-                auto p0 = f->vertex(0)->point();
-                auto p1 = f->vertex(1)->point();
-                auto p2 = f->vertex(2)->point();
-                auto c = CGAL::centroid(p0, p1, p2);
+                add(c.outer_boundary());
+                for (auto &h : c.holes())
+                        add(h);
+        }
 
-                if (object.contains({c.x(), c.y()}) < 0)
-                        seeds.push_back(c);
+        try
+        {
+                triangulation.insert_constraints(points.begin(), points.end(), indices.begin(), indices.end());
         }
+        catch (...)
+        {
+                // release the points while the arena is still alive
+                triangulation.clear();
+                throw;
+        }
+        d_timings["constraints"] = seconds_since(start);
 
+        start = std::chrono::steady_clock::now();
         set_extra_info();
+        d_timings["extra_info"] = seconds_since(start);
 }
 
-void Mesh2d::refine_delaunay(double aspect_bound, double size_bound)
+void Mesh2d::refine_delaunay(double aspect_bound, double size_bound, std::size_t num_strips)
 {
+        if (num_strips == 0)
+                num_strips = DEFAULT_STRIPS;
+
+        d_refined = true;
+        d_aspect_bound = aspect_bound;
+        d_size_bound = size_bound;
+        d_num_strips = num_strips;
+
+        StatsScope stats("mesh.refine");
+        ArenaScope scope;
+        DetachGuard guard(*this, scope);
+        auto start = std::chrono::steady_clock::now();
+        std::size_t before = triangulation.number_of_vertices();
+
+        if (num_strips > 1)
+        {
+                std::vector<Point_2> points = refine_strips(aspect_bound, size_bound, num_strips);
+                d_timings["strips"] = seconds_since(start);
+
+                start = std::chrono::steady_clock::now();
+                triangulation.insert(points.begin(), points.end());
+                d_timings["merge"] = seconds_since(start);
+
+                start = std::chrono::steady_clock::now();
+        }
+
         CGAL::refine_Delaunay_mesh_2(
             triangulation,
             seeds.begin(), seeds.end(),
             Delaunay_mesh_size_criteria_2(aspect_bound = aspect_bound, size_bound = size_bound));
+        if (!d_strip)
+                Stats::count(Stats::STEINER_POINTS, triangulation.number_of_vertices() - before);
+        d_timings["refine"] = seconds_since(start);
+
+        start = std::chrono::steady_clock::now();
+        set_extra_info();
+        d_timings["extra_info"] = seconds_since(start);
+}
+
+bool Mesh2d::reevaluate(const Object2d &object, const std::vector<double> &delta)
+{
+        StatsScope stats("mesh.reevaluate");
+        ArenaScope scope;
+        DetachGuard guard(*this, scope);
+        auto start = std::chrono::steady_clock::now();
+
+        // recorded operations need the full construction
+        bool moved = Tape::current() == nullptr && move_points(object, delta);
+        d_timings["move"] = seconds_since(start);
+
+        if (moved)
+        {
+                start = std::chrono::steady_clock::now();
+                set_extra_info();
+                d_timings["extra_info"] = seconds_since(start);
+        }
+        else
+        {
+                triangulation.clear();
+                d_object = object;
+                triangulate();
+                if (d_refined)
+                        refine_delaunay(d_aspect_bound, d_size_bound, d_num_strips);
+        }
+        return moved;
+}
+
+bool Mesh2d::move_points(const Object2d &object, const std::vector<double> &delta)
+{
+        if (object.ring_offsets() != d_object.ring_offsets())
+                return false;
+
+        // first order prediction of a coordinate at the new parameters
+        auto predict_value = [&delta](const DiffReal &x)
+        {
+                double value = CGAL::to_double(x);
+                for (std::size_t pos = 0; pos < x.derivs.size(); pos++)
+                        if (x.derivs.index(pos) < delta.size())
+                                value += x.derivs.value(pos) * delta[x.derivs.index(pos)];
+                return value;
+        };
+
+        // the vertices of the old object by their exact position; a ring of
+        // the new object may start at another corner, the start is taken
+        // where the predicted first corner lands, then every corner must be
+        // closer to its own prediction than its ring neighbors are
+        std::map<Point_2, Point_2> corners;
+        auto old_rings = d_object.rings();
+        auto new_rings = object.rings();
+        for (std::size_t r = 0; r < old_rings.size(); r++)
+        {
+                auto &old_points = old_rings[r]->container();
+                auto &new_points = new_rings[r]->container();
+                std::size_t n = old_points.size();
+
+                auto distance2 = [&](std::size_t i, std::size_t j)
+                {
+                        double dx = predict_value(old_points[i].x()) - CGAL::to_double(new_points[j % n].x());
+                        double dy = predict_value(old_points[i].y()) - CGAL::to_double(new_points[j % n].y());
+                        return dx * dx + dy * dy;
+                };
+
+                std::size_t start = 0;
+                for (std::size_t j = 1; j < n; j++)
+                        if (distance2(0, j) < distance2(0, start))
+                                start = j;
+
+                for (std::size_t i = 0; i < n; i++)
+                {
+                        double d = distance2(i, i + start);
+                        if (d > distance2(i, i + start + 1) || d > distance2(i, i + start + n - 1))
+                                return false;
+                        if (!corners.emplace(old_points[i], new_points[(i + start) % n]).second)
+                                return false;
+                }
+        }
+
+        // the index field holds the position of each vertex until set_extra_info
+        std::vector<Vertex_handle> vertices;
+        for (auto &v : triangulation.finite_vertex_handles())
+        {
+                v->info().index = vertices.size();
+                vertices.push_back(v);
+        }
+
+        // first order prediction for all, the boundary is overwritten below
+        auto predict = [&predict_value](const DiffReal &x)
+        {
+                return DiffReal(predict_value(x), Derivs(x.derivs));
+        };
+
+        std::vector<Point_2> points;
+        std::vector<char> is_corner(vertices.size(), 0);
+        points.reserve(vertices.size());
+        for (std::size_t k = 0; k < vertices.size(); k++)
+        {
+                auto &p = vertices[k]->point();
+                auto it = corners.find(p);
+                if (it != corners.end())
+                {
+                        points.push_back(it->second);
+                        is_corner[k] = 1;
+                }
+                else
+                        points.push_back(Point_2(predict(p.x()), predict(p.y())));
+        }
+
+        // the split points of an edge keep their relative position between its corners
+        for (std::size_t k = 0; k < vertices.size(); k++)
+        {
+                if (!is_corner[k])
+                        continue;
+
+                auto ec = triangulation.incident_edges(vertices[k]), done = ec;
+                do
+                {
+                        if (!triangulation.is_constrained(*ec))
+                                continue;
+
+                        std::vector<Vertex_handle> chain;
+                        Vertex_handle prev = vertices[k];
+                        Vertex_handle next = ec->first->vertex(Constrained_Delaunay_triangulation_2::ccw(ec->second));
+                        if (next == prev)
+                                next = ec->first->vertex(Constrained_Delaunay_triangulation_2::cw(ec->second));
+
+                        while (!is_corner[next->info().index])
+                        {
+                                chain.push_back(next);
+
+                                Vertex_handle after = prev;
+                                auto ec2 = triangulation.incident_edges(next), done2 = ec2;
+                                do
+                                {
+                                        if (!triangulation.is_constrained(*ec2))
+                                                continue;
+                                        Vertex_handle u = ec2->first->vertex(Constrained_Delaunay_triangulation_2::ccw(ec2->second));
+                                        if (u == next)
+                                                u = ec2->first->vertex(Constrained_Delaunay_triangulation_2::cw(ec2->second));
+                                        if (u != prev)
+                                                after = u;
+                                } while (++ec2 != done2);
+
+                                if (after == prev)
+                                        return false;
+                                prev = next;
+                                next = after;
+                        }
+
+                        auto &a = vertices[k]->point();
+                        auto &b = next->point();
+                        double bx = CGAL::to_double(b.x()) - CGAL::to_double(a.x());
+                        double by = CGAL::to_double(b.y()) - CGAL::to_double(a.y());
+                        double length2 = bx * bx + by * by;
+
+                        auto &na = points[vertices[k]->info().index];
+                        auto &nb = points[next->info().index];
+                        for (auto &v : chain)
+                        {
+                                double vx = CGAL::to_double(v->point().x()) - CGAL::to_double(a.x());
+                                double vy = CGAL::to_double(v->point().y()) - CGAL::to_double(a.y());
+                                DiffReal t((vx * bx + vy * by) / length2);
+                                points[v->info().index] = Point_2(na.x() + (nb.x() - na.x()) * t,
+                                                                  na.y() + (nb.y() - na.y()) * t);
+                        }
+                } while (++ec != done);
+        }
+
+        // every finite face must stay counterclockwise
+        for (auto &f : triangulation.finite_face_handles())
+        {
+                auto &a = points[f->vertex(0)->info().index];
+                auto &b = points[f->vertex(1)->info().index];
+                auto &c = points[f->vertex(2)->info().index];
+                if (CGAL::orientation(a, b, c) != CGAL::COUNTERCLOCKWISE)
+                        return false;
+        }
+
+        // and the convex hull convex, checked at consecutive hull edges
+        Vertex_handle infinite = triangulation.infinite_vertex();
+        for (auto &f : triangulation.all_face_handles())
+        {
+                if (!f->has_vertex(infinite))
+                        continue;
+
+                int i = f->index(infinite);
+                Face_handle g = f->neighbor(Constrained_Delaunay_triangulation_2::ccw(i));
+                int j = g->index(infinite);
+                auto &a = points[f->vertex(Constrained_Delaunay_triangulation_2::ccw(i))->info().index];
+                auto &b = points[f->vertex(Constrained_Delaunay_triangulation_2::cw(i))->info().index];
+                auto &c = points[g->vertex(Constrained_Delaunay_triangulation_2::cw(j))->info().index];
+                if (CGAL::orientation(a, b, c) == CGAL::COUNTERCLOCKWISE)
+                        return false;
+        }
+
+        for (std::size_t k = 0; k < vertices.size(); k++)
+                vertices[k]->set_point(points[k]);
+
+        // the connectivity is still valid, flips make it Delaunay again
+        restore_delaunay();
+
+        d_object = object;
+        return true;
+}
+
+std::vector<Mesh2d::Point_2> Mesh2d::refine_strips(double aspect_bound, double size_bound, std::size_t num_strips) const
+{
+        double xmin, ymin, xmax, ymax;
+        std::tie(xmin, ymin, xmax, ymax) = d_object.bbox();
+        if (!(xmin < xmax))
+                return {};
+
+        // the outer cuts lie beyond the bounding box, so no vertex is on them
+        double margin = (xmax - xmin) + (ymax - ymin) + 1.0;
+        std::vector<double> cuts(num_strips + 1);
+        cuts[0] = xmin - margin;
+        for (std::size_t k = 1; k < num_strips; k++)
+                cuts[k] = xmin + (xmax - xmin) * k / num_strips;
+        cuts[num_strips] = xmax + margin;
+
+        // the strips also refine their artificial cut edges, those Steiner
+        // points are dropped with a band around every interior cut, which the
+        // final refinement fills, so the result does not depend on num_strips
+        double band = size_bound > 0.0 ? size_bound : 0.25 * (xmax - xmin) / num_strips;
+
+        std::vector<std::vector<Point_2>> parts(num_strips);
+        auto refine = [&](std::size_t k)
+        {
+                StatsScope stats("mesh.strip");
+                std::vector<std::tuple<DiffReal, DiffReal>> corners = {
+                    std::make_tuple(DiffReal(cuts[k]), DiffReal(ymin - margin)),
+                    std::make_tuple(DiffReal(cuts[k + 1]), DiffReal(ymin - margin)),
+                    std::make_tuple(DiffReal(cuts[k + 1]), DiffReal(ymax + margin)),
+                    std::make_tuple(DiffReal(cuts[k]), DiffReal(ymax + margin)),
+                };
+                Object2d strip = d_object.intersection(Object2d::polygon(corners));
+
+                // the constructor and the refinement detach their points from the arena
+                Mesh2d mesh(strip);
+                mesh.d_strip = true;
+                mesh.refine_delaunay(aspect_bound, size_bound);
+
+                double left = k == 0 ? -HUGE_VAL : cuts[k] + band;
+                double right = k + 1 == num_strips ? HUGE_VAL : cuts[k + 1] - band;
+                for (auto &v : mesh.triangulation.finite_vertex_handles())
+                {
+                        if (v->info().index == UNSET)
+                                continue;
+                        double x = CGAL::to_double(v->point().x());
+                        if (left <= x && x < right)
+                                parts[k].push_back(v->point());
+                }
+        };
+
+        // the tape is thread local, so recorded operations must stay on this thread
+        if (Tape::current() == nullptr)
+        {
+                d_object.make_exact();
+                ThreadPool::global()->parallel_for(num_strips, refine);
+        }
+        else
+                for (std::size_t k = 0; k < num_strips; k++)
+                        refine(k);
+
+        std::vector<Point_2> points;
+        for (auto &part : parts)
+                points.insert(points.end(), part.begin(), part.end());
+        return points;
+}
+
+// value with forward derivatives in double precision, the vertices moved by
+// the smoother get rounded coordinates anyway
+struct Dual
+{
+        double value;
+        Derivs derivs;
+
+        Dual(double value) : value(value) {}
+        Dual(const DiffReal &x) : value(CGAL::to_double(x)), derivs(x.derivs) {}
+};
+
+static Dual operator+(const Dual &a, const Dual &b)
+{
+        Dual r(a);
+        r.value += b.value;
+        r.derivs.axpy(1.0, b.derivs);
+        return r;
+}
+
+static Dual operator-(const Dual &a, const Dual &b)
+{
+        Dual r(a);
+        r.value -= b.value;
+        r.derivs.axpy(-1.0, b.derivs);
+        return r;
+}
+
+static Dual operator*(const Dual &a, const Dual &b)
+{
+        Dual r(a);
+        r.value *= b.value;
+        r.derivs.scale_axpy(b.value, a.value, b.derivs);
+        return r;
+}
+
+static Dual operator*(const Dual &a, double b)
+{
+        Dual r(a);
+        r.value *= b;
+        r.derivs.scale(b);
+        return r;
+}
+
+static Dual operator/(const Dual &a, const Dual &b)
+{
+        Dual r(a);
+        r.value /= b.value;
+        r.derivs.scale_axpy(1.0 / b.value, -r.value / b.value, b.derivs);
+        return r;
+}
+
+struct Mesh2d::Target
+{
+        Dual x;
+        Dual y;
+        double displacement; // squared, relative to the shortest incident edge
+
+        Target() : x(0.0), y(0.0), displacement(0.0) {}
+};
+
+bool Mesh2d::optimal_position(Vertex_handle v, bool odt, Target &target) const
+{
+        Dual vx(v->point().x());
+        Dual vy(v->point().y());
+
+        std::vector<Dual> cx, cy, area;
+        double min_length = std::numeric_limits<double>::infinity();
+
+        auto fc = triangulation.incident_faces(v), done = fc;
+        do
+        {
+                Face_handle f = fc;
+                if (triangulation.is_infinite(f) || !f->info().inside())
+                        return false;
+
+                int i = f->index(v);
+                Dual ax(f->vertex(Constrained_Delaunay_triangulation_2::ccw(i))->point().x());
+                Dual ay(f->vertex(Constrained_Delaunay_triangulation_2::ccw(i))->point().y());
+                Dual bx(f->vertex(Constrained_Delaunay_triangulation_2::cw(i))->point().x());
+                Dual by(f->vertex(Constrained_Delaunay_triangulation_2::cw(i))->point().y());
+
+                // circumcenter relative to v
+                Dual ux = ax - vx, uy = ay - vy;
+                Dual wx = bx - vx, wy = by - vy;
+                Dual u2 = ux * ux + uy * uy;
+                Dual w2 = wx * wx + wy * wy;
+                Dual d = (ux * wy - uy * wx) * 2.0;
+                if (!(d.value > 0.0))
+                        return false;
+
+                cx.push_back(vx + (wy * u2 - uy * w2) / d);
+                cy.push_back(vy + (ux * w2 - wx * u2) / d);
+                area.push_back(d * 0.25);
+                min_length = std::min({min_length, u2.value, w2.value});
+        } while (++fc != done);
+
+        Dual x(0.0), y(0.0);
+        bool centroid = false;
+        if (!odt)
+        {
+                // the circumcenters in counterclockwise order bound the Voronoi cell
+                Dual a(0.0), sx(0.0), sy(0.0);
+                for (std::size_t i = 0; i < cx.size(); i++)
+                {
+                        std::size_t j = (i + 1) % cx.size();
+                        Dual cross = cx[i] * cy[j] - cx[j] * cy[i];
+                        a = a + cross;
+                        sx = sx + (cx[i] + cx[j]) * cross;
+                        sy = sy + (cy[i] + cy[j]) * cross;
+                }
+
+                // obtuse triangles can fold the cell, then use the ODT position
+                if (a.value > 0.0)
+                {
+                        x = sx / (a * 3.0);
+                        y = sy / (a * 3.0);
+                        centroid = true;
+                }
+        }
+
+        if (!centroid)
+        {
+                Dual a(0.0), sx(0.0), sy(0.0);
+                for (std::size_t i = 0; i < cx.size(); i++)
+                {
+                        a = a + area[i];
+                        sx = sx + cx[i] * area[i];
+                        sy = sy + cy[i] * area[i];
+                }
+                x = sx / a;
+                y = sy / a;
+        }
+
+        double dx = x.value - vx.value;
+        double dy = y.value - vy.value;
+        target.x = x;
+        target.y = y;
+        target.displacement = (dx * dx + dy * dy) / min_length;
+        return true;
+}
+
+int Mesh2d::lloyd_optimize(int max_iteration_number, double convergence, bool odt)
+{
+        // the new coordinates carry forward derivatives only
+        if (Tape::current() != nullptr)
+                throw std::logic_error("lloyd_optimize cannot be recorded on a tape");
+
+        StatsScope stats("mesh.lloyd");
+
+        const int MAX_ITERATIONS = 1000;
+        if (max_iteration_number <= 0)
+                max_iteration_number = MAX_ITERATIONS;
+
+        std::shared_ptr<ThreadPool> pool = ThreadPool::global();
+        int iteration = 0;
+        while (iteration < max_iteration_number)
+        {
+                iteration += 1;
+
+                std::vector<Vertex_handle> vertices;
+                for (auto &v : triangulation.finite_vertex_handles())
+                {
+                        v->point().x().make_exact();
+                        v->point().y().make_exact();
+                        if (v->info().index < d_num_vertices && !triangulation.are_there_incident_constraints(v))
+                                vertices.push_back(v);
+                }
+
+                // the targets are computed in parallel from the same old positions
+                std::vector<Target> targets(vertices.size());
+                std::vector<char> valid(vertices.size(), 0);
+                const std::size_t CHUNK = 256;
+                pool->parallel_for((vertices.size() + CHUNK - 1) / CHUNK, [&](std::size_t chunk)
+                                   {
+                        std::size_t end = std::min(vertices.size(), (chunk + 1) * CHUNK);
+                        for (std::size_t k = chunk * CHUNK; k < end; k++)
+                                valid[k] = optimal_position(vertices[k], odt, targets[k]); });
+
+                // moves are applied one by one, only when no incident face flips over
+                double max_displacement = 0.0;
+                for (std::size_t k = 0; k < vertices.size(); k++)
+                {
+                        if (!valid[k])
+                                continue;
+
+                        Vertex_handle v = vertices[k];
+                        Point_2 p(DiffReal(targets[k].x.value, std::move(targets[k].x.derivs)),
+                                  DiffReal(targets[k].y.value, std::move(targets[k].y.derivs)));
+
+                        bool ok = true;
+                        auto fc = triangulation.incident_faces(v), done = fc;
+                        do
+                        {
+                                Face_handle f = fc;
+                                int i = f->index(v);
+                                auto &a = f->vertex(Constrained_Delaunay_triangulation_2::ccw(i))->point();
+                                auto &b = f->vertex(Constrained_Delaunay_triangulation_2::cw(i))->point();
+                                if (CGAL::orientation(p, a, b) != CGAL::COUNTERCLOCKWISE)
+                                        ok = false;
+                        } while (ok && ++fc != done);
+
+                        if (!ok)
+                                continue;
+
+                        v->set_point(p);
+                        max_displacement = std::max(max_displacement, targets[k].displacement);
+                }
+
+                restore_delaunay();
+                if (max_displacement < convergence * convergence)
+                        break;
+        }
 
         set_extra_info();
+        return iteration;
 }
 
-void Mesh2d::lloyd_optimize(int max_iteration_number)
+void Mesh2d::restore_delaunay()
 {
-        throw std::logic_error("not implemented");
-        // CGAL::lloyd_optimize_mesh_2(triangulation, CGAL::parameters::max_iteration_number = max_iteration_number);
+        // a flip can break an edge that was already checked, so repeat until
+        // no edge is flipped (flips reuse the two faces, the iterator stays valid)
+        bool flipped = true;
+        while (flipped)
+        {
+                flipped = false;
+                for (auto &f : triangulation.finite_face_handles())
+                        for (int i = 0; i < 3; i++)
+                                if (triangulation.is_flipable(f, i))
+                                {
+                                        triangulation.flip(f, i);
+                                        flipped = true;
+                                }
+        }
+}
+
+double Mesh2d::seconds_since(std::chrono::steady_clock::time_point start)
+{
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 }
 
 void Mesh2d::set_extra_info()
 {
+        StatsScope stats("mesh.extra_info");
+
         for (auto &v : triangulation.all_vertex_handles())
                 v->info().index = UNSET;
 
@@ -74,6 +642,7 @@ void Mesh2d::set_extra_info()
 
         d_num_vertices = 0;
         d_num_faces = 0;
+        seeds.clear();
 
         std::vector<Face_handle> faces;
         Face_handle face = triangulation.infinite_face();
@@ -95,6 +664,13 @@ void Mesh2d::set_extra_info()
                         next->info().depth = face->info().depth + constrained;
                         faces.push_back(next);
 
+                        // seeds mark the bounded outside regions (holes) for the mesher,
+                        // where they are entered through a constraint
+                        if (constrained && !next->info().inside() && !triangulation.is_infinite(next))
+                                seeds.push_back(CGAL::centroid(next->vertex(0)->point(),
+                                                               next->vertex(1)->point(),
+                                                               next->vertex(2)->point()));
+
                         if (!next->info().inside())
                                 continue;
 
@@ -125,6 +701,23 @@ void Mesh2d::set_extra_info()
         }
 }
 
+void Mesh2d::detach_points()
+{
+        for (auto &v : triangulation.finite_vertex_handles())
+        {
+                auto &p = v->point();
+                if (p.x().in_arena() || p.y().in_arena())
+                        v->set_point(Object2d::detached(p));
+        }
+
+        for (auto &s : seeds)
+                if (s.x().in_arena() || s.y().in_arena())
+                        s = Object2d::detached(s);
+
+        if (d_object.in_arena())
+                d_object = d_object.detached();
+}
+
 std::vector<std::tuple<DiffReal, DiffReal>> Mesh2d::vertices() const
 {
         std::size_t count = 0;
@@ -161,3 +754,243 @@ std::vector<std::tuple<std::size_t, std::size_t, std::size_t>> Mesh2d::faces() c
         assert(result.size() == d_num_faces);
         return result;
 }
+
+std::size_t Mesh2d::num_derivs() const
+{
+        std::size_t n = 0;
+        for (auto &v : triangulation.finite_vertex_handles())
+        {
+                if (v->info().index >= d_num_vertices)
+                        continue;
+
+                auto &p = v->point();
+                n = std::max({n, p.x().derivs.dimension(), p.y().derivs.dimension()});
+        }
+        return n;
+}
+
+std::vector<double> Mesh2d::vertex_values() const
+{
+        std::vector<double> result(2 * d_num_vertices);
+        for (auto &v : triangulation.finite_vertex_handles())
+        {
+                std::size_t index = v->info().index;
+                if (index >= d_num_vertices)
+                        continue;
+
+                auto &p = v->point();
+                result[2 * index] = CGAL::to_double(p.x());
+                result[2 * index + 1] = CGAL::to_double(p.y());
+        }
+        return result;
+}
+
+std::vector<std::int64_t> Mesh2d::face_indices() const
+{
+        std::vector<std::int64_t> result;
+        result.reserve(3 * d_num_faces);
+        for (auto &f : triangulation.all_face_handles())
+        {
+                if (!f->info().inside())
+                        continue;
+
+                for (int i = 0; i < 3; i++)
+                        result.push_back(f->vertex(i)->info().index);
+        }
+
+        assert(result.size() == 3 * d_num_faces);
+        return result;
+}
+
+std::vector<double> Mesh2d::vertex_derivs(std::size_t num_derivs) const
+{
+        std::vector<double> result(2 * d_num_vertices * num_derivs);
+        for (auto &v : triangulation.finite_vertex_handles())
+        {
+                std::size_t index = v->info().index;
+                if (index >= d_num_vertices)
+                        continue;
+
+                auto &p = v->point();
+                p.x().derivs.get_dense(result.data() + (2 * index) * num_derivs, num_derivs);
+                p.y().derivs.get_dense(result.data() + (2 * index + 1) * num_derivs, num_derivs);
+        }
+        return result;
+}
+
+void Mesh2d::save(const std::string &path, bool exact) const
+{
+        std::size_t num_derivs = this->num_derivs();
+        MeshFile file(MeshFile::MESH, d_num_vertices, d_num_faces, 0, num_derivs);
+        file.add(vertex_values());
+        file.add(face_indices());
+        file.add(boundary_markers());
+        file.add(vertex_derivs(num_derivs));
+
+        if (exact)
+        {
+                std::vector<const DiffReal *> values(2 * d_num_vertices);
+                for (auto &v : triangulation.finite_vertex_handles())
+                {
+                        std::size_t index = v->info().index;
+                        if (index >= d_num_vertices)
+                                continue;
+
+                        values[2 * index] = &v->point().x();
+                        values[2 * index + 1] = &v->point().y();
+                }
+                file.add_exact(values);
+        }
+
+        file.write(path);
+}
+
+void Mesh2d::write_vtu(const std::string &path, std::size_t num_derivs) const
+{
+        MeshWriter(*this).write_vtu(path, num_derivs);
+}
+
+void Mesh2d::write_gmsh(const std::string &path) const
+{
+        MeshWriter(*this).write_gmsh(path);
+}
+
+void Mesh2d::write_obj(const std::string &path) const
+{
+        MeshWriter(*this).write_obj(path);
+}
+
+void Mesh2d::adjacency(std::vector<std::int64_t> &offsets, std::vector<std::int64_t> &neighbors) const
+{
+        std::vector<std::pair<std::int64_t, std::int64_t>> edges;
+        edges.reserve(6 * d_num_faces);
+        for (auto &f : triangulation.all_face_handles())
+        {
+                if (!f->info().inside())
+                        continue;
+
+                for (int i = 0; i < 3; i++)
+                {
+                        std::int64_t a = f->vertex(i)->info().index;
+                        std::int64_t b = f->vertex((i + 1) % 3)->info().index;
+                        edges.emplace_back(a, b);
+                        edges.emplace_back(b, a);
+                }
+        }
+
+        // interior edges are seen from both of their faces
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+        offsets.assign(d_num_vertices + 1, 0);
+        neighbors.resize(edges.size());
+        for (std::size_t i = 0; i < edges.size(); i++)
+        {
+                offsets[edges[i].first + 1] += 1;
+                neighbors[i] = edges[i].second;
+        }
+        for (std::size_t v = 0; v < d_num_vertices; v++)
+                offsets[v + 1] += offsets[v];
+}
+
+std::vector<std::uint8_t> Mesh2d::boundary_markers() const
+{
+        std::vector<std::uint8_t> result(d_num_vertices, 0);
+        for (auto &e : triangulation.finite_edges())
+        {
+                if (!triangulation.is_constrained(e))
+                        continue;
+
+                for (int i = 1; i <= 2; i++)
+                {
+                        std::size_t index = e.first->vertex((e.second + i) % 3)->info().index;
+                        if (index < d_num_vertices)
+                                result[index] = 1;
+                }
+        }
+        return result;
+}
+
+std::vector<double> Mesh2d::diffuse(std::size_t iterations, std::size_t num_derivs) const
+{
+        std::vector<std::int64_t> offsets, neighbors;
+        adjacency(offsets, neighbors);
+        std::vector<std::uint8_t> boundary = boundary_markers();
+
+        // value and derivatives of x, then of y, for every vertex
+        const std::size_t channels = 2 * (1 + num_derivs);
+        std::vector<double> current(d_num_vertices * channels);
+        for (auto &v : triangulation.finite_vertex_handles())
+        {
+                std::size_t index = v->info().index;
+                if (index >= d_num_vertices)
+                        continue;
+
+                double *row = current.data() + index * channels;
+                auto &p = v->point();
+                row[0] = CGAL::to_double(p.x());
+                p.x().derivs.get_dense(row + 1, num_derivs);
+                row[1 + num_derivs] = CGAL::to_double(p.y());
+                p.y().derivs.get_dense(row + 2 + num_derivs, num_derivs);
+        }
+        std::vector<double> next(current);
+
+        const std::size_t CHUNK = 1 << 12;
+        std::size_t chunks = (d_num_vertices + CHUNK - 1) / CHUNK;
+        std::shared_ptr<ThreadPool> pool = ThreadPool::global();
+
+        for (std::size_t iter = 0; iter < iterations; iter++)
+        {
+                // Jacobi steps, so the result does not depend on the thread count
+                pool->parallel_for(chunks, [&](std::size_t chunk)
+                                   {
+                        std::size_t end = std::min(d_num_vertices, (chunk + 1) * CHUNK);
+                        for (std::size_t v = chunk * CHUNK; v < end; v++)
+                        {
+                                if (boundary[v])
+                                        continue;
+
+                                double *row = next.data() + v * channels;
+                                const double *self = current.data() + v * channels;
+                                for (std::size_t c = 0; c < channels; c++)
+                                        row[c] = self[c];
+
+                                for (std::int64_t k = offsets[v]; k < offsets[v + 1]; k++)
+                                {
+                                        const double *other = current.data() + neighbors[k] * channels;
+                                        for (std::size_t c = 0; c < channels; c++)
+                                                row[c] += other[c];
+                                }
+
+                                double scale = 1.0 / (1 + offsets[v + 1] - offsets[v]);
+                                for (std::size_t c = 0; c < channels; c++)
+                                        row[c] *= scale;
+                        } });
+                current.swap(next);
+        }
+
+        // the rows are laid out as V x 2 x (1 + num_derivs)
+        return current;
+}
+
+std::vector<double> Mesh2d::gradient(const Tape &tape,
+                                     const std::vector<std::tuple<double, double>> &adjoints,
+                                     std::size_t num_derivs) const
+{
+        if (adjoints.size() != d_num_vertices)
+                throw std::invalid_argument("invalid number of adjoints");
+
+        std::vector<std::tuple<Tape::Node, double>> seeds;
+        seeds.reserve(2 * d_num_vertices);
+        for (auto &v : triangulation.all_vertex_handles())
+        {
+                std::size_t index = v->info().index;
+                if (index < d_num_vertices)
+                {
+                        auto &p = v->point();
+                        seeds.emplace_back(p.x().node, std::get<0>(adjoints[index]));
+                        seeds.emplace_back(p.y().node, std::get<1>(adjoints[index]));
+                }
+        }
+        return tape.gradient(seeds, num_derivs);
+}
@@ -22,10 +22,15 @@
 
 #include "diffreal.hpp"
 #include "object2d.hpp"
+#include "tape.hpp"
 
 #include <vector>
 #include <tuple>
 #include <limits>
+#include <map>
+#include <string>
+#include <chrono>
+#include <cstdint>
 
 #include <CGAL/Constrained_Delaunay_triangulation_2.h>
 #include <CGAL/Constrained_Delaunay_triangulation_face_base_2.h>
@@ -41,17 +46,65 @@ class Mesh2d
 public:
     Mesh2d(const Object2d &object);
 
-    void refine_delaunay(double aspect_bound = 0.125, double size_bound = 0.0);
-    void lloyd_optimize(int max_iteration_number = 0);
-
-    std::size_t num_vertices() const { return triangulation.number_of_vertices(); }
+    // with more than one strip the domain is cut into vertical strips that
+    // are refined in parallel, then their vertices are inserted into this
+    // triangulation and a final pass repairs the faces along the cuts; the
+    // result depends on num_strips only, 0 means 8 strips, not one per thread,
+    // so it is the same on every machine
+    void refine_delaunay(double aspect_bound = 0.125, double size_bound = 0.0, std::size_t num_strips = 1);
+    // moves the interior vertices to the centroids of their Voronoi cells
+    // (or to the optimal Delaunay positions with odt), 0 iterations means
+    // until the relative displacement drops below convergence
+    int lloyd_optimize(int max_iteration_number = 0, double convergence = 0.001, bool odt = false);
+
+    // moves the vertices to the given object, which must have been made with
+    // the parameters changed by delta: the vertices of the object are taken
+    // exactly, the ones on its edges keep their relative position and the
+    // others follow their derivatives; when a face would flip over, the mesh
+    // is rebuilt and refined again instead, then false is returned
+    bool reevaluate(const Object2d &object, const std::vector<double> &delta);
+
+    std::size_t num_vertices() const { return d_num_vertices; }
     std::size_t num_faces() const { return d_num_faces; }
 
     std::vector<std::tuple<DiffReal, DiffReal>> vertices() const;
     std::vector<std::tuple<std::size_t, std::size_t, std::size_t>> faces() const;
 
+    // flat row major arrays: values V x 2, faces F x 3, derivs V x 2 x num_derivs
+    std::size_t num_derivs() const;
+    std::vector<double> vertex_values() const;
+    std::vector<std::int64_t> face_indices() const;
+    std::vector<double> vertex_derivs(std::size_t num_derivs) const;
+
+    // vertex neighbors along the edges of inside faces, in compressed rows
+    void adjacency(std::vector<std::int64_t> &offsets, std::vector<std::int64_t> &neighbors) const;
+
+    // 1 for the vertices on constrained edges, 0 for the others
+    std::vector<std::uint8_t> boundary_markers() const;
+
+    // umbrella smoothing of the values and derivatives with fixed boundary
+    // vertices, returns a V x 2 x (1 + num_derivs) array
+    std::vector<double> diffuse(std::size_t iterations, std::size_t num_derivs) const;
+
+    // binary file with the exported arrays, see MeshFile
+    void save(const std::string &path, bool exact = false) const;
+
+    // standard formats written straight from the triangulation, see MeshWriter
+    void write_vtu(const std::string &path, std::size_t num_derivs = 0) const;
+    void write_gmsh(const std::string &path) const;
+    void write_obj(const std::string &path) const;
+
+    // wall clock seconds of the last run of each stage
+    const std::map<std::string, double> &timings() const { return d_timings; }
+
+    std::vector<double> gradient(const Tape &tape,
+                                 const std::vector<std::tuple<double, double>> &adjoints,
+                                 std::size_t num_derivs) const;
+
 protected:
     static const std::size_t UNSET = std::numeric_limits<std::size_t>::max();
+    // used for num_strips = 0
+    static const std::size_t DEFAULT_STRIPS = 8;
 
     struct VertexInfo
     {
@@ -91,13 +144,54 @@ protected:
     typedef CGAL::Delaunay_mesh_size_criteria_2<Constrained_Delaunay_triangulation_2>
         Delaunay_mesh_size_criteria_2;
 
+    struct Target;
+
+    void triangulate();
+    bool move_points(const Object2d &object, const std::vector<double> &delta);
+    std::vector<Point_2> refine_strips(double aspect_bound, double size_bound, std::size_t num_strips) const;
+    bool optimal_position(Vertex_handle v, bool odt, Target &target) const;
+    // flips the moved triangulation until it is constrained Delaunay again
+    void restore_delaunay();
     void set_extra_info();
+    void detach_points();
+
+    // detaches the points when the function is left, also by an exception,
+    // so the triangulation never references a released arena
+    class DetachGuard
+    {
+    public:
+        DetachGuard(Mesh2d &mesh, const ArenaScope &scope) : d_mesh(mesh), d_scope(scope) {}
+        ~DetachGuard()
+        {
+            if (d_scope.is_active())
+                d_mesh.detach_points();
+        }
+
+    protected:
+        Mesh2d &d_mesh;
+        const ArenaScope &d_scope;
+    };
+    static double seconds_since(std::chrono::steady_clock::time_point start);
 
+    Object2d d_object;
     Constrained_Delaunay_triangulation_2 triangulation;
     std::vector<Point_2> seeds;
 
     size_t d_num_vertices;
     size_t d_num_faces;
+
+    // the last refinement, repeated when reevaluate has to rebuild the mesh
+    bool d_refined;
+    double d_aspect_bound;
+    double d_size_bound;
+    std::size_t d_num_strips;
+
+    // the mesh of a single strip, whose Steiner points are counted after the merge
+    bool d_strip;
+
+    std::map<std::string, double> d_timings;
+
+    friend class MeshWriter;
 };
 
 #endif // MESH2D_HPP
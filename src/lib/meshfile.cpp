@@ -0,0 +1,183 @@
+/*
+ * Copyright 2023 Miklos Maroti.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include "meshfile.hpp"
+
+#include <cstring>
+#include <limits>
+#include <fstream>
+#include <stdexcept>
+
+static const char MAGIC[8] = {'D', 'I', 'F', 'F', 'M', 'E', 'S', 'H'};
+
+static_assert(sizeof(MeshFile::Header) == 64, "header must be 64 bytes");
+
+MeshFile::MeshFile(Kind kind, std::size_t num_vertices, std::size_t num_faces,
+                   std::size_t num_components, std::size_t num_derivs)
+    : d_position(0)
+{
+        std::memset(&d_header, 0, sizeof(Header));
+        std::memcpy(d_header.magic, MAGIC, sizeof(MAGIC));
+        d_header.version = VERSION;
+        d_header.kind = kind;
+        d_header.num_vertices = num_vertices;
+        d_header.num_faces = num_faces;
+        d_header.num_components = num_components;
+        d_header.num_derivs = num_derivs;
+}
+
+void MeshFile::append(const void *data, std::size_t size)
+{
+        std::size_t start = d_buffer.size();
+        d_buffer.resize(start + (size + 7) / 8 * 8, 0);
+        if (size > 0)
+                std::memcpy(d_buffer.data() + start, data, size);
+}
+
+void MeshFile::check(std::size_t count, std::size_t size) const
+{
+        if (count > (d_buffer.size() - d_position) / size)
+                throw std::invalid_argument("truncated mesh file");
+}
+
+std::size_t MeshFile::product(std::uint64_t a, std::uint64_t b)
+{
+        std::size_t limit = std::numeric_limits<std::size_t>::max();
+        if (a > limit || b > limit || (a != 0 && b > limit / a))
+                throw std::invalid_argument("invalid mesh file sizes");
+        return static_cast<std::size_t>(a * b);
+}
+
+void MeshFile::consume(void *data, std::size_t size)
+{
+        std::size_t padded = (size + 7) / 8 * 8;
+        if (d_position + padded > d_buffer.size())
+                throw std::invalid_argument("truncated mesh file");
+
+        if (size > 0)
+                std::memcpy(data, d_buffer.data() + d_position, size);
+        d_position += padded;
+}
+
+std::string MeshFile::exact_string(const DiffReal &value)
+{
+#if defined(DIFFMESH_FAST_KERNEL)
+        CGAL::Gmpq exact(value.value);
+#elif defined(DIFFMESH_LAZY_EXACT)
+        const CGAL::Gmpq &exact = value.value.exact();
+#else
+        const CGAL::Gmpq &exact = value.value;
+#endif
+
+        // the string is allocated by the GMP memory functions
+        void (*free_func)(void *, std::size_t);
+        mp_get_memory_functions(nullptr, nullptr, &free_func);
+        char *str = mpq_get_str(nullptr, 16, exact.mpq());
+        std::string result(str);
+        free_func(str, result.size() + 1);
+        return result;
+}
+
+// count, offsets count + 1, then the characters
+void MeshFile::add_exact(const std::vector<const DiffReal *> &values)
+{
+        std::vector<std::uint64_t> offsets(1, 0);
+        std::string chars;
+        for (auto v : values)
+        {
+                chars += exact_string(*v);
+                offsets.push_back(chars.size());
+        }
+
+        std::size_t start = d_buffer.size();
+        std::uint64_t count = values.size();
+        append(&count, sizeof(count));
+        add(offsets);
+        append(chars.data(), chars.size());
+        d_header.exact_size = d_buffer.size() - start;
+}
+
+std::vector<DiffReal::Value> MeshFile::next_exact()
+{
+        std::uint64_t count = next<std::uint64_t>(1)[0];
+        if (count >= d_buffer.size())
+                throw std::invalid_argument("invalid exact section");
+
+        std::vector<std::uint64_t> offsets = next<std::uint64_t>(count + 1);
+        if (offsets.front() != 0)
+                throw std::invalid_argument("invalid exact section");
+        std::vector<char> chars = next<char>(offsets.back());
+
+        std::vector<DiffReal::Value> result;
+        for (std::size_t i = 0; i < count; i++)
+        {
+                if (offsets[i] > offsets[i + 1])
+                        throw std::invalid_argument("invalid exact section");
+
+                std::string str(chars.data() + offsets[i], chars.data() + offsets[i + 1]);
+                CGAL::Gmpq exact;
+                if (mpq_set_str(exact.mpq(), str.c_str(), 16) != 0)
+                        throw std::invalid_argument("invalid exact value");
+                mpq_canonicalize(exact.mpq());
+
+#ifdef DIFFMESH_FAST_KERNEL
+                result.push_back(CGAL::to_double(exact));
+#else
+                result.push_back(DiffReal::Value(exact));
+#endif
+        }
+        return result;
+}
+
+void MeshFile::write(const std::string &path)
+{
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char *>(&d_header), sizeof(Header));
+        out.write(d_buffer.data(), d_buffer.size());
+        if (!out)
+                throw std::runtime_error("cannot write " + path);
+}
+
+MeshFile MeshFile::read(const std::string &path, Kind kind)
+{
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in)
+                throw std::invalid_argument("cannot open " + path);
+
+        std::size_t size = in.tellg();
+        in.seekg(0);
+
+        MeshFile file;
+        file.d_position = 0;
+        if (size < sizeof(Header) || !in.read(reinterpret_cast<char *>(&file.d_header), sizeof(Header)))
+                throw std::invalid_argument("truncated mesh file");
+
+        if (std::memcmp(file.d_header.magic, MAGIC, sizeof(MAGIC)) != 0)
+                throw std::invalid_argument("not a mesh file");
+        if (file.d_header.version != VERSION)
+                throw std::invalid_argument("unsupported mesh file version");
+        if (file.d_header.kind != static_cast<std::uint32_t>(kind))
+                throw std::invalid_argument(kind == MESH ? "not a mesh" : "not an object");
+
+        file.d_buffer.resize(size - sizeof(Header));
+        if (!in.read(file.d_buffer.data(), file.d_buffer.size()))
+                throw std::invalid_argument("truncated mesh file");
+        return file;
+}
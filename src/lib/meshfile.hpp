@@ -0,0 +1,112 @@
+/*
+ * Copyright 2023 Miklos Maroti.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef MESHFILE_HPP
+#define MESHFILE_HPP
+
+#include "diffreal.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Versioned binary layout of meshes and objects. A 64 byte header is
+ * followed by the arrays in a fixed order, each starting at a multiple of
+ * 8 bytes, so readers can memory map them in place. The optional exact
+ * section holds every coordinate as a base 16 rational string.
+ *
+ * mesh:   values V x 2, faces F x 3 (int64), boundary V (uint8),
+ *         derivs V x 2 x P, exact
+ * object: component offsets C + 1, ring offsets R + 1 (int64),
+ *         values V x 2, derivs V x 2 x P, exact
+ */
+class MeshFile
+{
+public:
+        static const std::uint32_t VERSION = 1;
+
+        enum Kind
+        {
+                MESH = 1,
+                OBJECT = 2
+        };
+
+        struct Header
+        {
+                char magic[8];
+                std::uint32_t version;
+                std::uint32_t kind;
+                std::uint64_t num_vertices;
+                std::uint64_t num_faces; // rings of an object
+                std::uint64_t num_components;
+                std::uint64_t num_derivs;
+                std::uint64_t exact_size; // zero when there is no exact section
+                std::uint64_t reserved;
+        };
+
+        MeshFile(Kind kind, std::size_t num_vertices, std::size_t num_faces,
+                 std::size_t num_components, std::size_t num_derivs);
+
+        const Header &header() const { return d_header; }
+
+        // appends the next section when writing
+        template <typename T>
+        void add(const std::vector<T> &data)
+        {
+                append(data.data(), data.size() * sizeof(T));
+        }
+        void add_exact(const std::vector<const DiffReal *> &values);
+        void write(const std::string &path);
+
+        // checks the magic, version and kind, then reads the whole file
+        static MeshFile read(const std::string &path, Kind kind);
+
+        // the next section when reading, count elements of type T
+        template <typename T>
+        std::vector<T> next(std::size_t count)
+        {
+                check(count, sizeof(T));
+                std::vector<T> result(count);
+                consume(result.data(), count * sizeof(T));
+                return result;
+        }
+        std::vector<DiffReal::Value> next_exact();
+
+        // product of section sizes from a header, throws if it overflows
+        static std::size_t product(std::uint64_t a, std::uint64_t b);
+
+        // the exact value of a coordinate as a base 16 rational string
+        static std::string exact_string(const DiffReal &value);
+
+protected:
+        MeshFile() {}
+
+        void append(const void *data, std::size_t size);
+        void check(std::size_t count, std::size_t size) const;
+        void consume(void *data, std::size_t size);
+
+        Header d_header;
+        std::vector<char> d_buffer;
+        std::size_t d_position;
+};
+
+#endif // MESHFILE_HPP
@@ -0,0 +1,317 @@
+/*
+ * Copyright 2023 Miklos Maroti.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include "meshwriter.hpp"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+MeshWriter::MeshWriter(const Mesh2d &mesh)
+    : d_mesh(mesh), d_vertices(mesh.d_num_vertices)
+{
+        for (auto &v : mesh.triangulation.finite_vertex_handles())
+                if (v->info().index < mesh.d_num_vertices)
+                        d_vertices[v->info().index] = v;
+}
+
+MeshWriter::Sink::Sink(const std::string &path)
+    : d_file(std::fopen(path.c_str(), "wb")), d_path(path), d_buffer(1 << 20), d_size(0)
+{
+        if (d_file == nullptr)
+                throw std::runtime_error("cannot open " + path);
+}
+
+MeshWriter::Sink::~Sink()
+{
+        if (d_file != nullptr)
+                std::fclose(d_file);
+}
+
+void MeshWriter::Sink::flush()
+{
+        if (d_size > 0 && std::fwrite(d_buffer.data(), 1, d_size, d_file) != d_size)
+                throw std::runtime_error("cannot write " + d_path);
+        d_size = 0;
+}
+
+void MeshWriter::Sink::write(const void *data, std::size_t size)
+{
+        if (d_size + size > d_buffer.size())
+        {
+                flush();
+                if (size > d_buffer.size())
+                {
+                        if (std::fwrite(data, 1, size, d_file) != size)
+                                throw std::runtime_error("cannot write " + d_path);
+                        return;
+                }
+        }
+
+        std::memcpy(d_buffer.data() + d_size, data, size);
+        d_size += size;
+}
+
+void MeshWriter::Sink::print(const char *format, ...)
+{
+        // a line of numbers always fits, longer text goes through a string
+        char line[256];
+        va_list args;
+        va_start(args, format);
+        int size = std::vsnprintf(line, sizeof(line), format, args);
+        va_end(args);
+
+        if (size < 0)
+                throw std::runtime_error("cannot format " + d_path);
+        if (static_cast<std::size_t>(size) < sizeof(line))
+        {
+                write(line, size);
+                return;
+        }
+
+        std::vector<char> text(size + 1);
+        va_start(args, format);
+        std::vsnprintf(text.data(), text.size(), format, args);
+        va_end(args);
+        write(text.data(), size);
+}
+
+void MeshWriter::Sink::close()
+{
+        flush();
+        std::FILE *file = d_file;
+        d_file = nullptr;
+        if (std::fclose(file) != 0)
+                throw std::runtime_error("cannot write " + d_path);
+}
+
+// a vertex is on the boundary if one of its edges is, so the written
+// boundary nodes and curve segments agree
+bool MeshWriter::is_boundary(Mesh2d::Vertex_handle v) const
+{
+        if (!d_mesh.triangulation.are_there_incident_constraints(v))
+                return false;
+
+        auto ec = d_mesh.triangulation.incident_edges(v), done = ec;
+        do
+        {
+                if (is_boundary(*ec))
+                        return true;
+        } while (++ec != done);
+        return false;
+}
+
+bool MeshWriter::is_boundary(const Mesh2d::Edge &e) const
+{
+        if (!d_mesh.triangulation.is_constrained(e))
+                return false;
+        return e.first->info().inside() || e.first->neighbor(e.second)->info().inside();
+}
+
+void MeshWriter::write_vtu(const std::string &path, std::size_t num_derivs) const
+{
+        std::uint64_t num_vertices = d_vertices.size();
+        std::uint64_t num_faces = d_mesh.d_num_faces;
+
+        const std::uint16_t probe = 1;
+        const char *byte_order = *reinterpret_cast<const char *>(&probe) == 1 ? "LittleEndian" : "BigEndian";
+
+        // every appended block starts with its size in bytes
+        std::uint64_t offset = 0;
+        auto block = [&offset](std::uint64_t size)
+        {
+                std::uint64_t start = offset;
+                offset += sizeof(std::uint64_t) + size;
+                return static_cast<unsigned long long>(start);
+        };
+
+        Sink sink(path);
+        sink.print("<?xml version=\"1.0\"?>\n");
+        sink.print("<VTKFile type=\"UnstructuredGrid\" version=\"1.0\" byte_order=\"%s\" header_type=\"UInt64\">\n", byte_order);
+        sink.print("  <UnstructuredGrid>\n");
+        sink.print("    <Piece NumberOfPoints=\"%llu\" NumberOfCells=\"%llu\">\n",
+                   static_cast<unsigned long long>(num_vertices), static_cast<unsigned long long>(num_faces));
+        sink.print("      <Points>\n");
+        sink.print("        <DataArray type=\"Float64\" NumberOfComponents=\"3\" format=\"appended\" offset=\"%llu\"/>\n",
+                   block(24 * num_vertices));
+        sink.print("      </Points>\n");
+        sink.print("      <PointData>\n");
+        sink.print("        <DataArray type=\"UInt8\" Name=\"boundary\" format=\"appended\" offset=\"%llu\"/>\n",
+                   block(num_vertices));
+        for (std::size_t k = 0; k < num_derivs; k++)
+                sink.print("        <DataArray type=\"Float64\" Name=\"deriv%zu\" NumberOfComponents=\"3\" format=\"appended\" offset=\"%llu\"/>\n",
+                           k, block(24 * num_vertices));
+        sink.print("      </PointData>\n");
+        sink.print("      <Cells>\n");
+        sink.print("        <DataArray type=\"Int64\" Name=\"connectivity\" format=\"appended\" offset=\"%llu\"/>\n",
+                   block(24 * num_faces));
+        sink.print("        <DataArray type=\"Int64\" Name=\"offsets\" format=\"appended\" offset=\"%llu\"/>\n",
+                   block(8 * num_faces));
+        sink.print("        <DataArray type=\"UInt8\" Name=\"types\" format=\"appended\" offset=\"%llu\"/>\n",
+                   block(num_faces));
+        sink.print("      </Cells>\n");
+        sink.print("    </Piece>\n");
+        sink.print("  </UnstructuredGrid>\n");
+        sink.print("  <AppendedData encoding=\"raw\">\n_");
+
+        put<std::uint64_t>(sink, 24 * num_vertices);
+        for (auto &v : d_vertices)
+        {
+                put<double>(sink, CGAL::to_double(v->point().x()));
+                put<double>(sink, CGAL::to_double(v->point().y()));
+                put<double>(sink, 0.0);
+        }
+
+        put<std::uint64_t>(sink, num_vertices);
+        for (auto &v : d_vertices)
+                put<std::uint8_t>(sink, is_boundary(v));
+
+        for (std::size_t k = 0; k < num_derivs; k++)
+        {
+                put<std::uint64_t>(sink, 24 * num_vertices);
+                for (auto &v : d_vertices)
+                {
+                        put<double>(sink, v->point().x().derivs.get(k));
+                        put<double>(sink, v->point().y().derivs.get(k));
+                        put<double>(sink, 0.0);
+                }
+        }
+
+        put<std::uint64_t>(sink, 24 * num_faces);
+        for (auto &f : d_mesh.triangulation.all_face_handles())
+                if (f->info().inside())
+                        for (int i = 0; i < 3; i++)
+                                put<std::int64_t>(sink, f->vertex(i)->info().index);
+
+        put<std::uint64_t>(sink, 8 * num_faces);
+        for (std::uint64_t i = 1; i <= num_faces; i++)
+                put<std::int64_t>(sink, 3 * i);
+
+        // VTK_TRIANGLE
+        put<std::uint64_t>(sink, num_faces);
+        for (std::uint64_t i = 0; i < num_faces; i++)
+                put<std::uint8_t>(sink, 5);
+
+        sink.print("\n  </AppendedData>\n");
+        sink.print("</VTKFile>\n");
+        sink.close();
+}
+
+void MeshWriter::write_gmsh(const std::string &path) const
+{
+        auto &triangulation = d_mesh.triangulation;
+
+        double xmin = std::numeric_limits<double>::infinity(), ymin = xmin;
+        double xmax = -xmin, ymax = -xmin;
+        std::size_t num_boundary = 0;
+        for (auto &v : d_vertices)
+        {
+                double x = CGAL::to_double(v->point().x());
+                double y = CGAL::to_double(v->point().y());
+                xmin = std::min(xmin, x);
+                xmax = std::max(xmax, x);
+                ymin = std::min(ymin, y);
+                ymax = std::max(ymax, y);
+                num_boundary += is_boundary(v);
+        }
+        if (d_vertices.empty())
+                xmin = ymin = xmax = ymax = 0.0;
+
+        std::size_t num_edges = 0;
+        for (auto &e : triangulation.finite_edges())
+                num_edges += is_boundary(e);
+
+        std::size_t num_vertices = d_vertices.size();
+        std::size_t num_faces = d_mesh.d_num_faces;
+
+        Sink sink(path);
+        sink.print("$MeshFormat\n4.1 0 8\n$EndMeshFormat\n");
+        sink.print("$PhysicalNames\n2\n1 1 \"boundary\"\n2 2 \"domain\"\n$EndPhysicalNames\n");
+
+        // one curve for all constrained edges, bounding one surface
+        sink.print("$Entities\n0 1 1 0\n");
+        sink.print("1 %.17g %.17g 0 %.17g %.17g 0 1 1 0\n", xmin, ymin, xmax, ymax);
+        sink.print("1 %.17g %.17g 0 %.17g %.17g 0 1 2 1 1\n", xmin, ymin, xmax, ymax);
+        sink.print("$EndEntities\n");
+
+        // node tags are the vertex indices plus one, boundary nodes live on the curve
+        sink.print("$Nodes\n2 %zu 1 %zu\n", num_vertices, num_vertices);
+        for (int dim = 1; dim <= 2; dim++)
+        {
+                bool boundary = dim == 1;
+                sink.print("%d 1 0 %zu\n", dim, boundary ? num_boundary : num_vertices - num_boundary);
+                for (std::size_t i = 0; i < num_vertices; i++)
+                        if (is_boundary(d_vertices[i]) == boundary)
+                                sink.print("%zu\n", i + 1);
+                for (auto &v : d_vertices)
+                        if (is_boundary(v) == boundary)
+                                sink.print("%.17g %.17g 0\n", CGAL::to_double(v->point().x()), CGAL::to_double(v->point().y()));
+        }
+        sink.print("$EndNodes\n");
+
+        sink.print("$Elements\n2 %zu 1 %zu\n", num_edges + num_faces, num_edges + num_faces);
+        std::size_t tag = 1;
+        sink.print("1 1 1 %zu\n", num_edges);
+        for (auto &e : triangulation.finite_edges())
+        {
+                if (!is_boundary(e))
+                        continue;
+
+                std::size_t a = e.first->vertex(Mesh2d::Constrained_Delaunay_triangulation_2::ccw(e.second))->info().index;
+                std::size_t b = e.first->vertex(Mesh2d::Constrained_Delaunay_triangulation_2::cw(e.second))->info().index;
+                sink.print("%zu %zu %zu\n", tag++, a + 1, b + 1);
+        }
+
+        sink.print("2 1 2 %zu\n", num_faces);
+        for (auto &f : triangulation.all_face_handles())
+        {
+                if (!f->info().inside())
+                        continue;
+
+                sink.print("%zu %zu %zu %zu\n", tag++,
+                           f->vertex(0)->info().index + 1,
+                           f->vertex(1)->info().index + 1,
+                           f->vertex(2)->info().index + 1);
+        }
+        sink.print("$EndElements\n");
+        sink.close();
+}
+
+void MeshWriter::write_obj(const std::string &path) const
+{
+        Sink sink(path);
+        for (auto &v : d_vertices)
+                sink.print("v %.17g %.17g 0\n", CGAL::to_double(v->point().x()), CGAL::to_double(v->point().y()));
+
+        for (auto &f : d_mesh.triangulation.all_face_handles())
+        {
+                if (!f->info().inside())
+                        continue;
+
+                sink.print("f %zu %zu %zu\n",
+                           f->vertex(0)->info().index + 1,
+                           f->vertex(1)->info().index + 1,
+                           f->vertex(2)->info().index + 1);
+        }
+        sink.close();
+}
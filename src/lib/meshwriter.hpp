@@ -0,0 +1,88 @@
+/*
+ * Copyright 2023 Miklos Maroti.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef MESHWRITER_HPP
+#define MESHWRITER_HPP
+
+#include "mesh2d.hpp"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*
+ * Writes a mesh straight from the triangulation into standard formats.
+ * Only the vertex handles are collected in index order, the coordinates,
+ * derivatives and faces go through a buffered file sink as they are read.
+ * Rounded double coordinates are written.
+ */
+class MeshWriter
+{
+public:
+        explicit MeshWriter(const Mesh2d &mesh);
+
+        // binary VTK unstructured grid with the boundary markers and one
+        // vector field per derivative as point data
+        void write_vtu(const std::string &path, std::size_t num_derivs) const;
+
+        // Gmsh 4.1 with the constrained edges in the "boundary" physical
+        // group and the triangles in the "domain" physical group
+        void write_gmsh(const std::string &path) const;
+
+        // Wavefront OBJ with zero z coordinates
+        void write_obj(const std::string &path) const;
+
+protected:
+        class Sink
+        {
+        public:
+                explicit Sink(const std::string &path);
+                ~Sink();
+
+                void write(const void *data, std::size_t size);
+                void print(const char *format, ...);
+                void close();
+
+        protected:
+                std::FILE *d_file;
+                std::string d_path;
+                std::vector<char> d_buffer;
+                std::size_t d_size;
+
+                void flush();
+
+                Sink(const Sink &) = delete;
+                Sink &operator=(const Sink &) = delete;
+        };
+
+        template <typename T>
+        static void put(Sink &sink, T value)
+        {
+                sink.write(&value, sizeof(T));
+        }
+
+        bool is_boundary(Mesh2d::Vertex_handle v) const;
+        bool is_boundary(const Mesh2d::Edge &e) const;
+
+        const Mesh2d &d_mesh;
+        std::vector<Mesh2d::Vertex_handle> d_vertices;
+};
+
+#endif // MESHWRITER_HPP
@@ -18,10 +18,317 @@
  */
 
 #include "object2d.hpp"
+#include "meshfile.hpp"
+#include "stats.hpp"
+#include "threadpool.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <numeric>
 #include <sstream>
 #include <CGAL/Boolean_set_operations_2.h>
-#include <CGAL/Bbox_2.h>
+
+static std::atomic<bool> persistent_sets(false);
+static std::atomic<double> snap_grid(0.0);
+static std::atomic<int> snap_bit_budget(0);
+
+static const double PI = 3.14159265358979323846;
+static const std::size_t MAX_ARC_SEGMENTS = 1 << 16;
+static const std::size_t MAX_CACHED_SEGMENTS = 1024;
+
+typedef std::vector<std::pair<double, double>> UnitCircle;
+
+// cosines and sines of the multiples of 2 pi / segments; with a multiple of
+// four the quadrants are exact rotations of the first one, so the shapes are
+// symmetric and the axis points exact
+static std::shared_ptr<const UnitCircle> make_unit_circle(std::size_t segments)
+{
+        auto points = std::make_shared<UnitCircle>(segments);
+        double step = 2.0 * PI / segments;
+        std::size_t quarter = segments % 4 == 0 ? segments / 4 : segments;
+        for (std::size_t i = 0; i < segments; i++)
+        {
+                if (i < quarter)
+                        (*points)[i] = std::make_pair(std::cos(i * step), std::sin(i * step));
+                else
+                {
+                        const std::pair<double, double> &p = (*points)[i - quarter];
+                        (*points)[i] = std::make_pair(-p.second, p.first);
+                }
+        }
+        return points;
+}
+
+// the tables of small counts are computed once, the segments derived from a
+// tolerance can take any value up to MAX_ARC_SEGMENTS, those are not kept
+static std::shared_ptr<const UnitCircle> unit_circle(std::size_t segments)
+{
+        if (segments > MAX_CACHED_SEGMENTS)
+                return make_unit_circle(segments);
+
+        static std::mutex mutex;
+        static std::map<std::size_t, std::shared_ptr<const UnitCircle>> tables;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        std::shared_ptr<const UnitCircle> &table = tables[segments];
+        if (table == nullptr)
+                table = make_unit_circle(segments);
+        return table;
+}
+// the operands are kept with the result, a hit is only returned when they
+// are equal to the current ones, so a colliding hash cannot return it
+struct MemoEntry
+{
+        Object2d result;
+        std::vector<Object2d> operands;
+};
+
+static MemoCache<MemoEntry> memo_cache;
+
+// 64 bit FNV-1a over the exact values and the nonzero derivatives, a key
+// digest also keeps the bytes, which the cache compares on a hit
+struct Digest
+{
+        std::uint64_t value;
+        bool keep;
+        std::string material;
+
+        explicit Digest(bool keep = false) : value(14695981039346656037ull), keep(keep) {}
+
+        void feed(const void *data, std::size_t size)
+        {
+                const unsigned char *bytes = static_cast<const unsigned char *>(data);
+                for (std::size_t i = 0; i < size; i++)
+                        value = (value ^ bytes[i]) * 1099511628211ull;
+                if (keep)
+                        material.append(static_cast<const char *>(data), size);
+        }
+
+        void feed(std::uint64_t x) { feed(&x, sizeof(x)); }
+
+        void feed(const DiffReal &x)
+        {
+                std::string exact = MeshFile::exact_string(x);
+                feed(exact.c_str(), exact.size() + 1);
+
+                // only the nonzero entries, so dense and sparse storage agree
+                for (std::size_t pos = 0; pos < x.derivs.size(); pos++)
+                {
+                        double d = x.derivs.value(pos);
+                        if (d == 0.0)
+                                continue;
+                        feed(x.derivs.index(pos));
+                        feed(&d, sizeof(d));
+                }
+                feed(std::numeric_limits<std::uint64_t>::max());
+        }
+};
+
+enum MemoTag
+{
+        MEMO_RECTANGLE = 1,
+        MEMO_CIRCLE,
+        MEMO_BOOLEAN,
+        MEMO_SIMPLIFY,
+        MEMO_ARC,
+        MEMO_ROUNDED_RECTANGLE
+};
+
+// recorded operations need their own tape nodes, so the tape bypasses the cache
+template <typename Key, typename Compute>
+Object2d Object2d::memoize(std::initializer_list<const Object2d *> operands, Key key, Compute compute)
+{
+        if (Tape::current() != nullptr || !memo_cache.is_enabled())
+                return compute();
+
+        // hashing an operand that is only a polygon set would extract its
+        // components, which costs as much as the operation
+        for (const Object2d *operand : operands)
+                if (operand->is_set_backed())
+                        return compute();
+
+        // the snap mode changes the results of transforms and booleans
+        Digest digest(true);
+        key(digest);
+        double grid = snap_grid.load();
+        digest.feed(&grid, sizeof(grid));
+        digest.feed(static_cast<std::uint64_t>(snap_bit_budget.load()));
+
+        MemoEntry entry;
+        auto same_operands = [&operands](const MemoEntry &cached)
+        {
+                if (cached.operands.size() != operands.size())
+                        return false;
+                std::size_t i = 0;
+                for (const Object2d *operand : operands)
+                        if (!cached.operands[i++].same_content(*operand))
+                                return false;
+                return true;
+        };
+        if (memo_cache.find(digest.value, digest.material, entry, same_operands))
+                return entry.result;
+
+        entry.result = compute();
+        // cached objects can be read by several threads
+        entry.result.make_exact();
+        Object2d result = entry.result;
+        if (entry.result.in_arena())
+                entry.result = entry.result.detached();
+        for (const Object2d *operand : operands)
+        {
+                operand->make_exact();
+                entry.operands.push_back(operand->in_arena() ? operand->detached() : *operand);
+        }
+        memo_cache.insert(digest.value, digest.material, entry);
+        return result;
+}
+
+// exact values and the same nonzero derivatives
+static bool same_coordinate(const DiffReal &a, const DiffReal &b)
+{
+        if (a.value != b.value)
+                return false;
+
+        std::size_t i = 0, j = 0;
+        for (;;)
+        {
+                while (i < a.derivs.size() && a.derivs.value(i) == 0.0)
+                        i++;
+                while (j < b.derivs.size() && b.derivs.value(j) == 0.0)
+                        j++;
+                if (i == a.derivs.size() || j == b.derivs.size())
+                        return i == a.derivs.size() && j == b.derivs.size();
+                if (a.derivs.index(i) != b.derivs.index(j) || a.derivs.value(i) != b.derivs.value(j))
+                        return false;
+                i++;
+                j++;
+        }
+}
+
+bool Object2d::same_content(const Object2d &other) const
+{
+        if (d_state == other.d_state)
+                return true;
+
+        const std::vector<Polygon_with_holes_2> &components1 = components();
+        const std::vector<Polygon_with_holes_2> &components2 = other.components();
+        if (components1.size() != components2.size())
+                return false;
+        for (std::size_t i = 0; i < components1.size(); i++)
+                if (components1[i].holes().size() != components2[i].holes().size())
+                        return false;
+
+        std::vector<const Polygon_2 *> rings1 = rings(), rings2 = other.rings();
+        for (std::size_t r = 0; r < rings1.size(); r++)
+        {
+                auto &points1 = rings1[r]->container();
+                auto &points2 = rings2[r]->container();
+                if (points1.size() != points2.size())
+                        return false;
+                for (std::size_t k = 0; k < points1.size(); k++)
+                        if (!same_coordinate(points1[k].x(), points2[k].x()) ||
+                            !same_coordinate(points1[k].y(), points2[k].y()))
+                                return false;
+        }
+        return true;
+}
+
+Object2d::Object2d() : d_state(std::make_shared<State>())
+{
+        d_state->has_components = true;
+        d_state->has_hash = false;
+}
+
+Object2d::Object2d(std::vector<Polygon_with_holes_2> &&components)
+    : d_state(std::make_shared<State>())
+{
+        d_state->has_components = true;
+        d_state->has_hash = false;
+        d_state->components = std::move(components);
+}
+
+Object2d::Object2d(const std::shared_ptr<const Polygon_set_2> &set)
+    : d_state(std::make_shared<State>())
+{
+        d_state->has_components = false;
+        d_state->has_hash = false;
+        d_state->set = set;
+}
+
+void Object2d::set_persistent(bool enabled)
+{
+        persistent_sets.store(enabled);
+}
+
+bool Object2d::is_persistent()
+{
+        return persistent_sets.load();
+}
+
+void Object2d::set_snap(double grid, int bits)
+{
+        if (!(grid >= 0.0 && std::isfinite(grid)))
+                throw std::invalid_argument("snap grid must be nonnegative");
+        if (bits < 0 || bits > 52)
+                throw std::invalid_argument("snap bits must be between 0 and 52");
+        if (grid > 0.0 && bits > 0)
+                throw std::invalid_argument("either the snap grid or the bits must be 0");
+
+        snap_grid.store(grid);
+        snap_bit_budget.store(bits);
+}
+
+void Object2d::set_memo_capacity(std::size_t capacity)
+{
+        memo_cache.set_capacity(capacity);
+}
+
+MemoStats Object2d::memo_stats()
+{
+        return memo_cache.get_stats();
+}
+
+void Object2d::reset_memo_stats()
+{
+        memo_cache.reset_stats();
+}
+
+void Object2d::clear_memo()
+{
+        memo_cache.clear();
+}
+
+const std::vector<Object2d::Polygon_with_holes_2> &Object2d::components() const
+{
+        std::lock_guard<std::mutex> lock(d_state->mutex);
+        if (!d_state->has_components)
+        {
+                d_state->set->polygons_with_holes(std::back_inserter(d_state->components));
+                d_state->has_components = true;
+        }
+
+        // the components never change once extracted
+        return d_state->components;
+}
+
+std::shared_ptr<const Object2d::Polygon_set_2> Object2d::polygon_set() const
+{
+        std::lock_guard<std::mutex> lock(d_state->mutex);
+        if (d_state->set != nullptr)
+                return d_state->set;
+
+        auto set = std::make_shared<Polygon_set_2>();
+        for (auto &c : d_state->components)
+                set->insert(c);
+
+        // a set built inside an arena scope would reference released memory
+        if (Arena::current() == nullptr && is_persistent())
+                d_state->set = set;
+        return set;
+}
 
 Object2d Object2d::polygon(const std::vector<std::tuple<DiffReal, DiffReal>> &points)
 {
@@ -32,12 +339,20 @@ Object2d Object2d::polygon(const std::vector<std::tuple<DiffReal, DiffReal>> &po
         if (!polygon.is_simple())
                 throw std::invalid_argument("polygon is not simple");
 
-        Object2d object;
-        object.components.emplace_back(polygon);
-        return object;
+        std::vector<Polygon_with_holes_2> components;
+        components.emplace_back(polygon);
+        return Object2d(std::move(components));
 }
 
 Object2d Object2d::rectangle(const DiffReal &width, const DiffReal &height)
+{
+        return memoize({}, [&](Digest &key)
+                       { key.feed(MEMO_RECTANGLE); key.feed(width); key.feed(height); },
+                       [&]()
+                       { return rectangle2(width, height); });
+}
+
+Object2d Object2d::rectangle2(const DiffReal &width, const DiffReal &height)
 {
         DiffReal width2(width * 0.5);
         DiffReal height2(height * 0.5);
@@ -51,24 +366,146 @@ Object2d Object2d::rectangle(const DiffReal &width, const DiffReal &height)
 }
 
 Object2d Object2d::circle(const DiffReal &radius, std::size_t segments)
+{
+        return memoize({}, [&](Digest &key)
+                       { key.feed(MEMO_CIRCLE); key.feed(radius); key.feed(segments); },
+                       [&]()
+                       { return circle2(radius, segments); });
+}
+
+Object2d Object2d::circle2(const DiffReal &radius, std::size_t segments)
 {
         if (radius <= 0.0 || segments < 3)
                 throw std::invalid_argument("invalid radius or segments");
 
-        double step = 2.0 * 3.14159265358979323846 / segments;
+        std::shared_ptr<const UnitCircle> table = unit_circle(segments);
         std::vector<std::tuple<DiffReal, DiffReal>> points;
-        for (std::size_t i = 0; i < segments; ++i)
-                points.emplace_back(radius * std::cos(i * step), radius * std::sin(i * step));
+        for (auto &p : *table)
+                points.emplace_back(radius * p.first, radius * p.second);
 
         return polygon(points);
 }
 
-std::size_t Object2d::num_components() const { return components.size(); }
+Object2d Object2d::arc(const DiffReal &radius, double start, double angle, std::size_t segments,
+                       const DiffReal &inner_radius)
+{
+        return memoize({}, [&](Digest &key)
+                       {
+                                key.feed(MEMO_ARC);
+                                key.feed(radius);
+                                key.feed(&start, sizeof(start));
+                                key.feed(&angle, sizeof(angle));
+                                key.feed(segments);
+                                key.feed(inner_radius); },
+                       [&]()
+                       { return arc2(radius, start, angle, segments, inner_radius); });
+}
+
+Object2d Object2d::arc2(const DiffReal &radius, double start, double angle, std::size_t segments,
+                        const DiffReal &inner_radius)
+{
+        if (radius <= 0.0 || inner_radius < 0.0 || inner_radius >= radius)
+                throw std::invalid_argument("invalid radius or inner radius");
+        if (!(angle > 0.0 && angle < 2.0 * PI) || !std::isfinite(start) || segments < 1)
+                throw std::invalid_argument("invalid angle or segments");
+
+        double step = angle / segments;
+        std::vector<std::tuple<DiffReal, DiffReal>> points;
+        for (std::size_t i = 0; i <= segments; i++)
+                points.emplace_back(radius * std::cos(start + i * step), radius * std::sin(start + i * step));
+
+        if (inner_radius == 0.0)
+                points.emplace_back(DiffReal(0.0), DiffReal(0.0));
+        else
+                for (std::size_t i = segments + 1; i-- > 0;)
+                        points.emplace_back(inner_radius * std::cos(start + i * step),
+                                            inner_radius * std::sin(start + i * step));
+
+        return polygon(points);
+}
+
+Object2d Object2d::rounded_rectangle(const DiffReal &width, const DiffReal &height,
+                                     const DiffReal &radius, std::size_t segments)
+{
+        return memoize({}, [&](Digest &key)
+                       {
+                                key.feed(MEMO_ROUNDED_RECTANGLE);
+                                key.feed(width);
+                                key.feed(height);
+                                key.feed(radius);
+                                key.feed(segments); },
+                       [&]()
+                       { return rounded_rectangle2(width, height, radius, segments); });
+}
+
+Object2d Object2d::rounded_rectangle2(const DiffReal &width, const DiffReal &height,
+                                      const DiffReal &radius, std::size_t segments)
+{
+        if (width <= 0.0 || height <= 0.0 || radius < 0.0 || radius * 2.0 > width || radius * 2.0 > height)
+                throw std::invalid_argument("invalid width, height or radius");
+        if (segments < 1)
+                throw std::invalid_argument("invalid segments");
+        if (radius == 0.0)
+                return rectangle2(width, height);
+
+        // the corners walk the quadrants of one table, a straight side of
+        // zero length (a stadium) leaves no repeated point
+        std::shared_ptr<const UnitCircle> table = unit_circle(4 * segments);
+        DiffReal xcenter(width * 0.5 - radius);
+        DiffReal ycenter(height * 0.5 - radius);
+        std::vector<std::tuple<DiffReal, DiffReal>> points;
+        for (std::size_t q = 0; q < 4; q++)
+        {
+                DiffReal x(q == 0 || q == 3 ? xcenter : -xcenter);
+                DiffReal y(q <= 1 ? ycenter : -ycenter);
+                for (std::size_t i = 0; i <= segments; i++)
+                {
+                        const std::pair<double, double> &p = (*table)[(q * segments + i) % table->size()];
+                        std::tuple<DiffReal, DiffReal> point(x + radius * p.first, y + radius * p.second);
+                        if (points.empty() || point != points.back())
+                                points.push_back(std::move(point));
+                }
+        }
+        if (points.back() == points.front())
+                points.pop_back();
+
+        return polygon(points);
+}
+
+std::size_t Object2d::arc_segments(double radius, double angle, double tolerance, double edge_length)
+{
+        if (!(radius > 0.0) || !(angle > 0.0) || !(tolerance >= 0.0) || !(edge_length >= 0.0))
+                throw std::invalid_argument("invalid radius, angle, tolerance or edge length");
+        if (tolerance == 0.0 && edge_length == 0.0)
+                throw std::invalid_argument("either the tolerance or the edge length must be positive");
+
+        // the largest central angle of a segment that meets both bounds
+        double step = angle;
+        if (tolerance > 0.0 && tolerance < radius)
+                step = std::min(step, 2.0 * std::acos(1.0 - tolerance / radius));
+        if (edge_length > 0.0 && edge_length < 2.0 * radius)
+                step = std::min(step, 2.0 * std::asin(0.5 * edge_length / radius));
+
+        double count = std::ceil(angle / step * (1.0 - 1e-12));
+        return static_cast<std::size_t>(std::max(1.0, std::min(count, double(MAX_ARC_SEGMENTS))));
+}
+
+std::size_t Object2d::circle_segments(double radius, double tolerance, double edge_length)
+{
+        return std::max<std::size_t>(arc_segments(radius, 2.0 * PI, tolerance, edge_length), 3);
+}
+
+std::size_t Object2d::corner_segments(double radius, double tolerance, double edge_length)
+{
+        return arc_segments(radius, 0.5 * PI, tolerance, edge_length);
+}
+
+std::size_t Object2d::num_components() const { return components().size(); }
 
 std::size_t Object2d::num_polygons() const
 {
         std::size_t n = 0;
-        for (auto &p : components)
+        for (auto &p : components())
                 n += 1 + p.number_of_holes();
         return n;
 }
@@ -76,7 +513,7 @@ std::size_t Object2d::num_polygons() const
 std::size_t Object2d::num_vertices() const
 {
         std::size_t n = 0;
-        for (auto &c : components)
+        for (auto &c : components())
         {
                 n += c.outer_boundary().container().size();
                 for (auto &h : c.holes())
@@ -88,24 +525,41 @@ std::size_t Object2d::num_vertices() const
 std::tuple<double, double, double, double> Object2d::bbox() const
 {
         CGAL::Bbox_2 bbox;
-        for (auto &c : components)
-                bbox += c.bbox();
+        std::shared_ptr<const Polygon_set_2> set;
+        {
+                std::lock_guard<std::mutex> lock(d_state->mutex);
+                if (!d_state->has_components)
+                        set = d_state->set;
+        }
+
+        // avoid extracting the components only for the bounding box
+        if (set != nullptr)
+        {
+                auto &arr = set->arrangement();
+                for (auto v = arr.vertices_begin(); v != arr.vertices_end(); ++v)
+                        bbox += v->point().bbox();
+        }
+        else
+        {
+                for (auto &c : components())
+                        bbox += c.bbox();
+        }
 
         return {bbox.xmin(), bbox.ymin(), bbox.xmax(), bbox.ymax()};
 }
 
 Object2d Object2d::get_component(std::size_t index) const
 {
+        auto &components = this->components();
         if (index >= components.size())
                 throw std::invalid_argument("invalid component index");
 
-        Object2d object;
-        object.components.emplace_back(components[index]);
-        return object;
+        return Object2d(std::vector<Polygon_with_holes_2>(1, components[index]));
 }
 
 Object2d Object2d::get_polygon(std::size_t index) const
 {
+        auto &components = this->components();
         if (components.size() != 1)
                 throw std::invalid_argument("must have a single component");
 
@@ -123,13 +577,12 @@ Object2d Object2d::get_polygon(std::size_t index) const
         }
         assert(polygon.is_simple() && polygon.is_counterclockwise_oriented());
 
-        Object2d object;
-        object.components.emplace_back(polygon);
-        return object;
+        return Object2d(std::vector<Polygon_with_holes_2>(1, Polygon_with_holes_2(polygon)));
 }
 
 std::vector<std::tuple<DiffReal, DiffReal>> Object2d::get_vertices() const
 {
+        auto &components = this->components();
         if (components.size() != 1)
                 throw std::invalid_argument("must have a single component");
 
@@ -144,86 +597,503 @@ std::vector<std::tuple<DiffReal, DiffReal>> Object2d::get_vertices() const
         return result;
 }
 
+std::vector<const Object2d::Polygon_2 *> Object2d::rings() const
+{
+        std::vector<const Polygon_2 *> result;
+        for (auto &c : components())
+        {
+                result.push_back(&c.outer_boundary());
+                for (auto &h : c.holes())
+                        result.push_back(&h);
+        }
+        return result;
+}
+
+void Object2d::make_exact() const
+{
+#ifdef DIFFMESH_LAZY_EXACT
+        for (auto r : rings())
+                for (auto &v : r->container())
+                {
+                        v.x().make_exact();
+                        v.y().make_exact();
+                }
+#endif
+}
+
+std::size_t Object2d::num_derivs() const
+{
+        std::size_t n = 0;
+        for (auto r : rings())
+                for (auto &v : r->container())
+                        n = std::max({n, v.x().derivs.dimension(), v.y().derivs.dimension()});
+        return n;
+}
+
+std::vector<std::int64_t> Object2d::ring_offsets() const
+{
+        std::vector<std::int64_t> result(1, 0);
+        for (auto r : rings())
+                result.push_back(result.back() + r->container().size());
+        return result;
+}
+
+std::vector<double> Object2d::vertex_values() const
+{
+        std::vector<double> result;
+        for (auto r : rings())
+        {
+                for (auto &v : r->container())
+                {
+                        result.push_back(CGAL::to_double(v.x()));
+                        result.push_back(CGAL::to_double(v.y()));
+                }
+        }
+        return result;
+}
+
+std::vector<double> Object2d::vertex_derivs(std::size_t num_derivs) const
+{
+        std::vector<double> result(2 * num_vertices() * num_derivs);
+        double *output = result.data();
+        for (auto r : rings())
+        {
+                for (auto &v : r->container())
+                {
+                        v.x().derivs.get_dense(output, num_derivs);
+                        v.y().derivs.get_dense(output + num_derivs, num_derivs);
+                        output += 2 * num_derivs;
+                }
+        }
+        return result;
+}
+
+void Object2d::save(const std::string &path, bool exact) const
+{
+        std::vector<std::int64_t> component_offsets(1, 0);
+        for (auto &c : components())
+                component_offsets.push_back(component_offsets.back() + 1 + c.holes().size());
+
+        std::vector<std::int64_t> offsets = ring_offsets();
+        std::size_t num_derivs = this->num_derivs();
+        MeshFile file(MeshFile::OBJECT, offsets.back(), offsets.size() - 1,
+                      component_offsets.size() - 1, num_derivs);
+        file.add(component_offsets);
+        file.add(offsets);
+        file.add(vertex_values());
+        file.add(vertex_derivs(num_derivs));
+
+        if (exact)
+        {
+                std::vector<const DiffReal *> values;
+                for (auto r : rings())
+                {
+                        for (auto &v : r->container())
+                        {
+                                values.push_back(&v.x());
+                                values.push_back(&v.y());
+                        }
+                }
+                file.add_exact(values);
+        }
+
+        file.write(path);
+}
+
+Object2d Object2d::load(const std::string &path)
+{
+        MeshFile file = MeshFile::read(path, MeshFile::OBJECT);
+        const MeshFile::Header &header = file.header();
+
+        // every component has a ring and every ring three vertices, which
+        // also keeps the counts below away from overflow
+        if (header.num_components > header.num_faces ||
+            MeshFile::product(3, header.num_faces) > header.num_vertices)
+                throw std::invalid_argument("invalid mesh file sizes");
+        std::size_t num_coords = MeshFile::product(2, header.num_vertices);
+
+        std::vector<std::int64_t> component_offsets = file.next<std::int64_t>(header.num_components + 1);
+        std::vector<std::int64_t> offsets = file.next<std::int64_t>(header.num_faces + 1);
+        std::vector<double> values = file.next<double>(num_coords);
+        std::vector<double> derivs = file.next<double>(MeshFile::product(num_coords, header.num_derivs));
+
+        std::vector<DiffReal::Value> exact;
+        if (header.exact_size != 0)
+        {
+                exact = file.next_exact();
+                if (exact.size() != values.size())
+                        throw std::invalid_argument("invalid exact section");
+        }
+
+        for (std::size_t i = 0; i + 1 < component_offsets.size(); i++)
+                if (component_offsets[i] >= component_offsets[i + 1])
+                        throw std::invalid_argument("invalid component offsets");
+        for (std::size_t i = 0; i + 1 < offsets.size(); i++)
+                if (offsets[i] < 0 || offsets[i + 1] < offsets[i] || offsets[i + 1] - offsets[i] < 3)
+                        throw std::invalid_argument("invalid ring offsets");
+        if (component_offsets.front() != 0 || component_offsets.back() != static_cast<std::int64_t>(header.num_faces) ||
+            offsets.front() != 0 || offsets.back() != static_cast<std::int64_t>(header.num_vertices))
+                throw std::invalid_argument("invalid offsets");
+
+        // sparse derivatives, most coordinates depend on few parameters
+        auto coordinate = [&](std::size_t k)
+        {
+                std::vector<std::size_t> indices;
+                std::vector<double> entries;
+                for (std::size_t j = 0; j < header.num_derivs; j++)
+                {
+                        double d = derivs[k * header.num_derivs + j];
+                        if (d != 0.0)
+                        {
+                                indices.push_back(j);
+                                entries.push_back(d);
+                        }
+                }
+
+                DiffReal x(values[k], indices, entries);
+                if (!exact.empty())
+                        x.value = exact[k];
+                return x;
+        };
+
+        auto ring = [&](std::size_t r)
+        {
+                Polygon_2 polygon;
+                for (std::int64_t i = offsets[r]; i < offsets[r + 1]; i++)
+                        polygon.push_back(Point_2(coordinate(2 * i), coordinate(2 * i + 1)));
+                return polygon;
+        };
+
+        std::vector<Polygon_with_holes_2> components;
+        for (std::size_t c = 0; c + 1 < component_offsets.size(); c++)
+        {
+                Polygon_with_holes_2 component(ring(component_offsets[c]));
+                for (std::int64_t r = component_offsets[c] + 1; r < component_offsets[c + 1]; r++)
+                        component.holes().push_back(ring(r));
+                components.push_back(component);
+        }
+        return Object2d(std::move(components));
+}
+
+std::uint64_t Object2d::hash() const
+{
+        {
+                std::lock_guard<std::mutex> lock(d_state->mutex);
+                if (d_state->has_hash)
+                        return d_state->hash;
+        }
+
+        Digest digest;
+        for (auto &c : components())
+                digest.feed(c.holes().size());
+
+        for (auto r : rings())
+        {
+                digest.feed(r->container().size());
+                for (auto &v : r->container())
+                {
+                        digest.feed(v.x());
+                        digest.feed(v.y());
+                }
+        }
+
+        // objects are immutable, so the hash is computed once
+        std::lock_guard<std::mutex> lock(d_state->mutex);
+        d_state->hash = digest.value;
+        d_state->has_hash = true;
+        return digest.value;
+}
+
 Object2d Object2d::transform(Aff_Transformation_2 trans) const
 {
-        Object2d object;
-        for (auto &c : components)
+        std::vector<Polygon_with_holes_2> components;
+        for (auto &c : this->components())
         {
                 Polygon_with_holes_2 polygon(CGAL::transform(trans, c.outer_boundary()));
                 for (auto &h : c.holes())
                         polygon.holes().push_back(CGAL::transform(trans, h));
-                object.components.push_back(polygon);
+                components.push_back(polygon);
         }
-        return object;
+        return Object2d(std::move(components));
 }
 
+// transforms are not memoized, hashing the exact coordinates of the operand
+// costs more than transforming them
 Object2d Object2d::translate(const DiffReal &xdiff, const DiffReal &ydiff) const
 {
-        return transform(Aff_Transformation_2(CGAL::TRANSLATION, Vector_2(xdiff, ydiff)));
+        return transform(Aff_Transformation_2(CGAL::TRANSLATION, Vector_2(xdiff, ydiff))).auto_snap();
 }
 
 Object2d Object2d::rotate(const DiffReal &angle) const
 {
-        return transform(Aff_Transformation_2(CGAL::ROTATION, angle.sin(), angle.cos()));
+        return transform(Aff_Transformation_2(CGAL::ROTATION, angle.sin(), angle.cos())).auto_snap();
 }
 
 Object2d Object2d::scale(const DiffReal &scale) const
 {
-        return transform(Aff_Transformation_2(CGAL::SCALING, scale));
+        return transform(Aff_Transformation_2(CGAL::SCALING, scale)).auto_snap();
 }
 
-Object2d Object2d::join(const Object2d &other) const
+Object2d Object2d::join(const Object2d &other) const &
 {
-        Polygon_set_2 set1;
-        for (auto &c : components)
-                set1.insert(c);
+        return memoized_boolean(other, JOIN, false);
+}
 
-        Polygon_set_2 set2;
-        for (auto &c : other.components)
-                set2.insert(c);
+Object2d Object2d::intersection(const Object2d &other) const &
+{
+        return memoized_boolean(other, INTERSECTION, false);
+}
 
-        set1.join(set2);
-        Object2d object;
-        set1.polygons_with_holes(std::back_inserter(object.components));
-        return object;
+Object2d Object2d::difference(const Object2d &other) const &
+{
+        return memoized_boolean(other, DIFFERENCE, false);
 }
 
-Object2d Object2d::intersection(const Object2d &other) const
+Object2d Object2d::join(const Object2d &other) &&
 {
-        Polygon_set_2 set1;
-        for (auto &c : components)
-                set1.insert(c);
+        return memoized_boolean(other, JOIN, true);
+}
 
-        Polygon_set_2 set2;
-        for (auto &c : other.components)
-                set2.insert(c);
+Object2d Object2d::intersection(const Object2d &other) &&
+{
+        return memoized_boolean(other, INTERSECTION, true);
+}
 
-        set1.intersection(set2);
-        Object2d object;
-        set1.polygons_with_holes(std::back_inserter(object.components));
-        return object;
+Object2d Object2d::difference(const Object2d &other) &&
+{
+        return memoized_boolean(other, DIFFERENCE, true);
 }
 
-Object2d Object2d::difference(const Object2d &other) const
+Object2d Object2d::memoized_boolean(const Object2d &other, Operation operation, bool reuse) const
 {
-        Polygon_set_2 set1;
-        for (auto &c : components)
-                set1.insert(c);
+        return memoize({this, &other}, [&](Digest &key)
+                       { key.feed(MEMO_BOOLEAN); key.feed(operation); key.feed(hash()); key.feed(other.hash()); },
+                       [&]()
+                       { return boolean(other, operation, reuse).auto_snap(); });
+}
+
+void Object2d::apply(Polygon_set_2 &set, const Polygon_set_2 &other, Operation operation)
+{
+        if (operation == JOIN)
+                set.join(other);
+        else if (operation == INTERSECTION)
+                set.intersection(other);
+        else
+                set.difference(other);
+}
+
+std::vector<std::size_t> Object2d::clusters(const std::vector<CGAL::Bbox_2> &boxes)
+{
+        std::vector<std::size_t> parent(boxes.size());
+        std::iota(parent.begin(), parent.end(), 0);
+
+        auto find = [&parent](std::size_t i)
+        {
+                while (parent[i] != i)
+                {
+                        parent[i] = parent[parent[i]];
+                        i = parent[i];
+                }
+                return i;
+        };
+
+        std::vector<std::size_t> order(boxes.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&boxes](std::size_t a, std::size_t b)
+                  { return boxes[a].xmin() < boxes[b].xmin(); });
+
+        // sweep in x, boxes that touch are in the same cluster
+        std::vector<std::size_t> active;
+        for (std::size_t i : order)
+        {
+                const CGAL::Bbox_2 &box = boxes[i];
+                std::size_t k = 0;
+                for (std::size_t j : active)
+                {
+                        if (boxes[j].xmax() < box.xmin())
+                                continue;
+
+                        active[k++] = j;
+                        if (boxes[j].ymin() <= box.ymax() && box.ymin() <= boxes[j].ymax())
+                                parent[find(i)] = find(j);
+                }
+                active.resize(k);
+                active.push_back(i);
+        }
+
+        std::vector<std::size_t> result(boxes.size());
+        for (std::size_t i = 0; i < boxes.size(); i++)
+                result[i] = find(i);
+        return result;
+}
 
-        Polygon_set_2 set2;
-        for (auto &c : other.components)
-                set2.insert(c);
+bool Object2d::is_set_backed() const
+{
+        std::lock_guard<std::mutex> lock(d_state->mutex);
+        return !d_state->has_components;
+}
 
-        set1.difference(set2);
-        Object2d object;
-        set1.polygons_with_holes(std::back_inserter(object.components));
+std::shared_ptr<Object2d::Polygon_set_2> Object2d::release_set() const
+{
+        if (d_state.use_count() != 1)
+                return nullptr;
+
+        std::lock_guard<std::mutex> lock(d_state->mutex);
+        if (d_state->set == nullptr || d_state->set.use_count() != 1)
+                return nullptr;
+
+        // nothing else can see this object, so it is left empty
+        auto set = std::const_pointer_cast<Polygon_set_2>(d_state->set);
+        d_state->set.reset();
+        d_state->components.clear();
+        d_state->has_components = true;
+        d_state->has_hash = false;
+        return set;
+}
+
+Object2d Object2d::boolean(const Object2d &other, Operation operation, bool reuse) const
+{
+        StatsScope stats("object.boolean");
+        ArenaScope scope;
+
+        auto combine = [&]()
+        {
+                // x.join(x) must not empty its own operand before reading it
+                bool alias = d_state == other.d_state;
+                std::shared_ptr<Polygon_set_2> set = reuse && !alias ? release_set() : nullptr;
+                if (set == nullptr)
+                {
+                        // a set built just now is not shared, so it needs no copy
+                        std::shared_ptr<const Polygon_set_2> base = polygon_set();
+                        if (base.use_count() == 1)
+                                set = std::const_pointer_cast<Polygon_set_2>(base);
+                        else
+                                set = std::make_shared<Polygon_set_2>(*base);
+                }
+                apply(*set, *other.polygon_set(), operation);
+                return finish(scope, set);
+        };
+
+        // extracting the components of a polygon set only for the clustering
+        // would cost as much as the boolean itself
+        if (is_set_backed() || other.is_set_backed())
+                return combine();
+
+        const std::vector<Polygon_with_holes_2> &components1 = components();
+        const std::vector<Polygon_with_holes_2> &components2 = other.components();
+
+        std::vector<CGAL::Bbox_2> boxes;
+        for (auto &c : components1)
+                boxes.push_back(c.outer_boundary().bbox());
+        for (auto &c : components2)
+                boxes.push_back(c.outer_boundary().bbox());
+
+        std::vector<std::size_t> roots = clusters(boxes);
+
+        // a single cluster keeps the polygon set of the result
+        if (std::all_of(roots.begin(), roots.end(), [&roots](std::size_t r)
+                        { return r == roots.front(); }))
+                return combine();
+
+        struct Cluster
+        {
+                std::vector<std::size_t> members;
+                bool first;
+                bool second;
+                std::vector<Polygon_with_holes_2> result;
+        };
+
+        const std::size_t none = std::numeric_limits<std::size_t>::max();
+        std::size_t count1 = components1.size();
+        std::vector<Cluster> clusters;
+        std::vector<std::size_t> cluster_index(roots.size(), none);
+        for (std::size_t i = 0; i < roots.size(); i++)
+        {
+                std::size_t &k = cluster_index[roots[i]];
+                if (k == none)
+                {
+                        k = clusters.size();
+                        clusters.push_back(Cluster{{}, false, false, {}});
+                }
+                clusters[k].members.push_back(i);
+                (i < count1 ? clusters[k].first : clusters[k].second) = true;
+        }
+
+        auto component = [&](std::size_t i) -> const Polygon_with_holes_2 &
+        {
+                return i < count1 ? components1[i] : components2[i - count1];
+        };
+
+        // components that meet nothing of the other operand are passed through or dropped
+        std::vector<std::size_t> work;
+        for (std::size_t k = 0; k < clusters.size(); k++)
+        {
+                Cluster &c = clusters[k];
+                if (c.first && c.second)
+                        work.push_back(k);
+                else if (operation == JOIN || (operation == DIFFERENCE && c.first))
+                        for (std::size_t i : c.members)
+                                c.result.push_back(component(i));
+        }
+
+        auto compute = [&](std::size_t w)
+        {
+                Cluster &c = clusters[work[w]];
+
+                // workers have no arena of the caller, but may open their own
+                ArenaScope task_scope;
+
+                auto set = std::make_shared<Polygon_set_2>();
+                Polygon_set_2 set2;
+                for (std::size_t i : c.members)
+                {
+                        if (i < count1)
+                                set->insert(component(i));
+                        else
+                                set2.insert(component(i));
+                }
+                apply(*set, set2, operation);
+
+                Object2d part = finish(task_scope, set);
+                c.result = part.components();
+        };
+
+        // the tape is thread local, so recorded operations must stay on this thread
+        if (work.size() > 1 && Tape::current() == nullptr)
+        {
+                make_exact();
+                other.make_exact();
+                ThreadPool::global()->parallel_for(work.size(), compute);
+        }
+        else
+                for (std::size_t w = 0; w < work.size(); w++)
+                        compute(w);
+
+        std::vector<Polygon_with_holes_2> result;
+        for (auto &c : clusters)
+                result.insert(result.end(), c.result.begin(), c.result.end());
+
+        Object2d object(std::move(result));
+        if (scope.is_active() && object.in_arena())
+                return object.detached();
         return object;
 }
 
 Object2d Object2d::simplify(double epsilon) const
 {
-        Polygon_set_2 set1;
-        for (auto &c : components)
+        return memoize({this}, [&](Digest &key)
+                       { key.feed(MEMO_SIMPLIFY); key.feed(hash()); key.feed(&epsilon, sizeof(epsilon)); },
+                       [&]()
+                       { return simplify_components(epsilon); });
+}
+
+Object2d Object2d::simplify_components(double epsilon) const
+{
+        StatsScope stats("object.simplify");
+        ArenaScope scope;
+
+        auto set1 = std::make_shared<Polygon_set_2>();
+        for (auto &c : components())
         {
                 Polygon_2 p = simplify2(c.outer_boundary(), epsilon);
                 if (p.is_empty())
@@ -235,12 +1105,10 @@ Object2d Object2d::simplify(double epsilon) const
                 for (auto &h : c.holes())
                         set2.difference(simplify2(h, epsilon));
 
-                set1.join(set2);
+                set1->join(set2);
         }
 
-        Object2d object;
-        set1.polygons_with_holes(std::back_inserter(object.components));
-        return object;
+        return finish(scope, set1);
 }
 
 Object2d::Polygon_2 Object2d::simplify2(const Polygon_2 &polygon, double epsilon)
@@ -275,10 +1143,229 @@ Object2d::Polygon_2 Object2d::simplify2(const Polygon_2 &polygon, double epsilon
         return Polygon_2(points.begin(), points.end());
 }
 
-int Object2d::contains(const std::tuple<DiffReal, DiffReal> &point) const
+Object2d Object2d::snap(double grid) const
+{
+        if (!(grid > 0.0 && std::isfinite(grid)))
+                throw std::invalid_argument("snap grid must be positive");
+
+        StatsScope stats("object.snap");
+
+        const std::vector<Polygon_with_holes_2> &original = components();
+        std::vector<Polygon_with_holes_2> result;
+        std::vector<CGAL::Bbox_2> boxes;
+        for (auto &c : original)
+        {
+                Polygon_with_holes_2 snapped;
+                if (!snap_component(c, grid, snapped))
+                {
+                        Stats::count(Stats::SNAP_FALLBACKS);
+                        snapped = c;
+                }
+                boxes.push_back(snapped.outer_boundary().bbox());
+                result.push_back(std::move(snapped));
+        }
+
+        // components that were apart must stay apart
+        for (std::size_t i = 0; i < result.size(); i++)
+                for (std::size_t j = i + 1; j < result.size(); j++)
+                        if (CGAL::do_overlap(boxes[i], boxes[j]) && CGAL::do_intersect(result[i], result[j]))
+                        {
+                                Stats::count(Stats::SNAP_FALLBACKS);
+                                return *this;
+                        }
+
+        if (Stats::is_enabled())
+        {
+                Stats::count(Stats::SNAP_BITS_IN, bit_size(original));
+                Stats::count(Stats::SNAP_BITS_OUT, bit_size(result));
+        }
+        return Object2d(std::move(result));
+}
+
+Object2d Object2d::snap_bits(int bits) const
+{
+        if (bits < 1 || bits > 52)
+                throw std::invalid_argument("snap bits must be between 1 and 52");
+
+        double xmin, ymin, xmax, ymax;
+        std::tie(xmin, ymin, xmax, ymax) = bbox();
+        double extent = std::max(std::max(std::abs(xmin), std::abs(xmax)),
+                                 std::max(std::abs(ymin), std::abs(ymax)));
+        if (!(extent > 0.0 && std::isfinite(extent)))
+                return *this;
+
+        int exponent;
+        std::frexp(extent, &exponent);
+        return snap(std::ldexp(1.0, exponent - bits));
+}
+
+Object2d Object2d::auto_snap() const
+{
+        double grid = snap_grid.load();
+        int bits = snap_bit_budget.load();
+        if (grid > 0.0)
+                return snap(grid);
+        else if (bits > 0)
+                return snap_bits(bits);
+        return *this;
+}
+
+// the multiples of grid are rounded to doubles, so coordinates that are
+// already on the grid stay exactly where they are
+static DiffReal snap_value(const DiffReal &x, double grid)
+{
+        DiffReal result(x);
+        result.value = std::round(x.get_value() / grid) * grid;
+        return result;
+}
+
+bool Object2d::snap_ring(const Polygon_2 &ring, double grid, Polygon_2 &result)
+{
+        std::vector<Point_2> points;
+        for (auto i = ring.vertices_begin(); i != ring.vertices_end(); ++i)
+        {
+                Point_2 point(snap_value(i->x(), grid), snap_value(i->y(), grid));
+                if (points.empty() || point != points.back())
+                        points.push_back(point);
+        }
+        while (points.size() >= 2 && points.front() == points.back())
+                points.pop_back();
+        if (points.size() < 3)
+                return false;
+
+        result = Polygon_2(points.begin(), points.end());
+        return result.is_simple() && result.orientation() == ring.orientation();
+}
+
+bool Object2d::snap_component(const Polygon_with_holes_2 &component, double grid, Polygon_with_holes_2 &result)
+{
+        Polygon_2 outer;
+        if (!snap_ring(component.outer_boundary(), grid, outer))
+                return false;
+
+        std::vector<Polygon_2> holes;
+        for (auto &h : component.holes())
+        {
+                holes.emplace_back();
+                if (!snap_ring(h, grid, holes.back()))
+                        return false;
+        }
+
+        result = Polygon_with_holes_2(outer, holes.begin(), holes.end());
+
+        // the holes must stay inside the boundary and apart from each other
+        return holes.empty() || CGAL::is_valid_polygon_with_holes(result, Polygon_set_2::Traits_2());
+}
+
+std::size_t Object2d::bit_size(const std::vector<Polygon_with_holes_2> &components)
 {
-        Point_2 p(std::get<0>(point), std::get<1>(point));
+        std::size_t bits = 0;
+        auto add = [&bits](const Polygon_2 &ring)
+        {
+                for (auto i = ring.vertices_begin(); i != ring.vertices_end(); ++i)
+                        bits += i->x().bit_size() + i->y().bit_size();
+        };
         for (auto &c : components)
+        {
+                add(c.outer_boundary());
+                for (auto &h : c.holes())
+                        add(h);
+        }
+        return bits;
+}
+
+std::shared_ptr<const EdgeGrid> Object2d::edge_grid() const
+{
+        const std::vector<Polygon_with_holes_2> &components = this->components();
+
+        std::lock_guard<std::mutex> lock(d_state->mutex);
+        if (d_state->grid == nullptr)
+        {
+                std::vector<EdgeGrid::Segment> segments;
+                auto add = [&segments](const Polygon_2 &polygon)
+                {
+                        auto &points = polygon.container();
+                        for (std::size_t i = 0; i < points.size(); i++)
+                        {
+                                auto &a = points[i];
+                                auto &b = points[(i + 1) % points.size()];
+                                segments.push_back({CGAL::to_double(a.x()), CGAL::to_double(a.y()),
+                                                    CGAL::to_double(b.x()), CGAL::to_double(b.y())});
+                        }
+                };
+
+                for (auto &c : components)
+                {
+                        add(c.outer_boundary());
+                        for (auto &h : c.holes())
+                                add(h);
+                }
+                d_state->grid = std::make_shared<EdgeGrid>(segments);
+        }
+        return d_state->grid;
+}
+
+int Object2d::contains(const std::tuple<DiffReal, DiffReal> &point) const
+{
+        const DiffReal &x = std::get<0>(point);
+        const DiffReal &y = std::get<1>(point);
+
+        int r = edge_grid()->classify(CGAL::to_double(x), CGAL::to_double(y));
+        if (r != EdgeGrid::UNDECIDED)
+                return r;
+
+        return contains_exact(Point_2(x, y));
+}
+
+std::vector<int> Object2d::contains_many(const std::vector<std::tuple<DiffReal, DiffReal>> &points) const
+{
+        StatsScope stats("object.contains");
+        std::shared_ptr<const EdgeGrid> grid = edge_grid();
+
+        std::vector<int> result(points.size());
+        for (std::size_t i = 0; i < points.size(); i++)
+        {
+                const DiffReal &x = std::get<0>(points[i]);
+                const DiffReal &y = std::get<1>(points[i]);
+
+                int r = grid->classify(CGAL::to_double(x), CGAL::to_double(y));
+                result[i] = r != EdgeGrid::UNDECIDED ? r : contains_exact(Point_2(x, y));
+        }
+        return result;
+}
+
+void Object2d::contains_many(const double *coords, std::size_t count, int *result) const
+{
+        StatsScope stats("object.contains");
+        std::shared_ptr<const EdgeGrid> grid = edge_grid();
+
+        const std::size_t CHUNK = 1 << 14;
+        auto classify = [&](std::size_t chunk)
+        {
+                std::size_t end = std::min(count, (chunk + 1) * CHUNK);
+                for (std::size_t i = chunk * CHUNK; i < end; i++)
+                {
+                        double x = coords[2 * i];
+                        double y = coords[2 * i + 1];
+
+                        int r = grid->classify(x, y);
+                        result[i] = r != EdgeGrid::UNDECIDED ? r : contains_exact(Point_2(DiffReal(x), DiffReal(y)));
+                }
+        };
+
+        std::size_t chunks = (count + CHUNK - 1) / CHUNK;
+        if (chunks > 1)
+        {
+                make_exact();
+                ThreadPool::global()->parallel_for(chunks, classify);
+        }
+        else if (chunks == 1)
+                classify(0);
+}
+
+int Object2d::contains_exact(const Point_2 &p) const
+{
+        for (auto &c : components())
         {
                 auto r = CGAL::oriented_side(p, c);
                 if (r == CGAL::ON_POSITIVE_SIDE)
@@ -289,11 +1376,78 @@ int Object2d::contains(const std::tuple<DiffReal, DiffReal> &point) const
         return -1;
 }
 
+bool Object2d::in_arena() const
+{
+        if (Arena::current() == nullptr)
+                return false;
+
+        auto polygon_in_arena = [](const Polygon_2 &polygon)
+        {
+                for (auto &v : polygon.container())
+                        if (v.x().in_arena() || v.y().in_arena())
+                                return true;
+                return false;
+        };
+
+        for (auto &c : components())
+        {
+                if (polygon_in_arena(c.outer_boundary()))
+                        return true;
+                for (auto &h : c.holes())
+                        if (polygon_in_arena(h))
+                                return true;
+        }
+        return false;
+}
+
+Object2d::Point_2 Object2d::detached(const Point_2 &point)
+{
+        ArenaScope::Suspend suspend;
+        return Point_2(point.x().detached(), point.y().detached());
+}
+
+Object2d::Polygon_2 Object2d::detached(const Polygon_2 &polygon)
+{
+        std::vector<Point_2> points;
+        points.reserve(polygon.size());
+        for (auto &v : polygon.container())
+                points.push_back(detached(v));
+        return Polygon_2(points.begin(), points.end());
+}
+
+Object2d Object2d::detached() const
+{
+        std::vector<Polygon_with_holes_2> components;
+        for (auto &c : this->components())
+        {
+                Polygon_with_holes_2 polygon(detached(c.outer_boundary()));
+                for (auto &h : c.holes())
+                        polygon.holes().push_back(detached(h));
+                components.push_back(polygon);
+        }
+        return Object2d(std::move(components));
+}
+
+Object2d Object2d::finish(const ArenaScope &scope, const std::shared_ptr<Polygon_set_2> &set)
+{
+        if (!scope.is_active() && is_persistent())
+                return Object2d(std::shared_ptr<const Polygon_set_2>(set));
+
+        std::vector<Polygon_with_holes_2> components;
+        set->polygons_with_holes(std::back_inserter(components));
+        Object2d object(std::move(components));
+
+        // the result must not reference the arena that is about to be released
+        if (scope.is_active() && object.in_arena())
+                return object.detached();
+        return object;
+}
+
 std::string Object2d::repr() const
 {
         std::stringstream str;
         str << "Object2d";
-        for (auto &c : components)
+        for (auto &c : components())
                 str << " [" << c << "]";
         return str.str();
 }
@@ -21,20 +21,52 @@
 #define OBJECT2D_HPP
 
 #include "diffreal.hpp"
+#include "arena.hpp"
+#include "edgegrid.hpp"
+#include "memo.hpp"
 
 #include <vector>
 #include <tuple>
+#include <memory>
+#include <cstdint>
+#include <initializer_list>
+#include <mutex>
+#include <string>
 
 #include <CGAL/Polygon_set_2.h>
 #include <CGAL/Polygon_with_holes_2.h>
 #include <CGAL/Aff_transformation_2.h>
+#include <CGAL/Bbox_2.h>
 
+/*
+ * Immutable polygonal region. The result of a boolean operation keeps its
+ * Polygon_set_2 alive, so chained operations reuse the arrangement instead
+ * of inserting every edge again, and the polygons with holes are extracted
+ * only when they are first needed. Copies share the same state.
+ */
 class Object2d
 {
 public:
+        Object2d();
+
         static Object2d polygon(const std::vector<std::tuple<DiffReal, DiffReal>> &points);
         static Object2d rectangle(const DiffReal &width, const DiffReal &height);
         static Object2d circle(const DiffReal &radius, std::size_t segments = 24);
+        // circular sector from the start angle counterclockwise, or a ring
+        // segment with a positive inner radius, the angles are in radians
+        static Object2d arc(const DiffReal &radius, double start, double angle, std::size_t segments,
+                            const DiffReal &inner_radius = DiffReal(0.0));
+        // centered rectangle with quarter circle corners of the given number of segments
+        static Object2d rounded_rectangle(const DiffReal &width, const DiffReal &height,
+                                          const DiffReal &radius, std::size_t segments = 4);
+
+        // number of segments for an arc of the given angle whose chords are
+        // within tolerance of it and not longer than edge_length (the
+        // size_bound of the mesher), 0 turns off either bound
+        static std::size_t arc_segments(double radius, double angle, double tolerance, double edge_length);
+        // the same for a full circle and for a quarter circle corner
+        static std::size_t circle_segments(double radius, double tolerance, double edge_length);
+        static std::size_t corner_segments(double radius, double tolerance, double edge_length);
 
         std::size_t num_components() const;
         std::size_t num_polygons() const;
@@ -45,6 +77,13 @@ public:
         Object2d get_polygon(std::size_t index) const;
         std::vector<std::tuple<DiffReal, DiffReal>> get_vertices() const;
 
+        // all rings (outer boundary then holes of each component) as flat row
+        // major arrays: offsets R + 1, values V x 2, derivs V x 2 x num_derivs
+        std::size_t num_derivs() const;
+        std::vector<std::int64_t> ring_offsets() const;
+        std::vector<double> vertex_values() const;
+        std::vector<double> vertex_derivs(std::size_t num_derivs) const;
+
         Object2d translate(const DiffReal &xdiff, const DiffReal &ydiff) const;
         Object2d translate(double xdiff, double ydiff) const
         {
@@ -63,15 +102,60 @@ public:
                 return this->scale(DiffReal(scale));
         }
 
-        Object2d join(const Object2d &other) const;
-        Object2d intersection(const Object2d &other) const;
-        Object2d difference(const Object2d &other) const;
+        Object2d join(const Object2d &other) const &;
+        Object2d intersection(const Object2d &other) const &;
+        Object2d difference(const Object2d &other) const &;
+
+        // a temporary whose polygon set is not shared hands it over to the
+        // result, so chains like a = std::move(a).join(b) do not copy it
+        Object2d join(const Object2d &other) &&;
+        Object2d intersection(const Object2d &other) &&;
+        Object2d difference(const Object2d &other) &&;
         Object2d simplify(double epsilon = 0.001) const;
 
+        // rounds the coordinates to multiples of grid and keeps the derivatives,
+        // a component that would become degenerate or self intersecting keeps
+        // its coordinates, and so does the whole object if components would overlap
+        Object2d snap(double grid) const;
+        // snaps to the power of two grid that leaves bits significant bits
+        // for the largest coordinate
+        Object2d snap_bits(int bits) const;
+
+        // snaps the results of transforms and booleans to the grid or the bit
+        // budget, with both 0 (the default) nothing is snapped
+        static void set_snap(double grid, int bits = 0);
+
+        // 1 inside, 0 on the boundary, -1 outside
         int contains(const std::tuple<DiffReal, DiffReal> &point) const;
+        std::vector<int> contains_many(const std::vector<std::tuple<DiffReal, DiffReal>> &points) const;
+        void contains_many(const double *coords, std::size_t count, int *result) const;
 
         std::string repr() const;
 
+        // binary file with the rings, values and derivatives, see MeshFile
+        void save(const std::string &path, bool exact = false) const;
+        static Object2d load(const std::string &path);
+
+        // digest of the exact coordinates, derivatives and ring structure
+        std::uint64_t hash() const;
+
+        // whether some coordinate lives in the arena of the current thread
+        bool in_arena() const;
+
+        // deep copy with all coordinates on the heap
+        Object2d detached() const;
+
+        // whether boolean results keep their polygon set, disabled by default
+        static void set_persistent(bool enabled);
+        static bool is_persistent();
+
+        // results of primitives, booleans and simplify keyed by the hashes
+        // of their operands, disabled with zero capacity (default)
+        static void set_memo_capacity(std::size_t capacity);
+        static MemoStats memo_stats();
+        static void reset_memo_stats();
+        static void clear_memo();
+
 protected:
         typedef CGAL::Polygon_with_holes_2<Kernel> Polygon_with_holes_2;
         typedef CGAL::Aff_transformation_2<Kernel> Aff_Transformation_2;
@@ -80,10 +164,64 @@ protected:
         typedef CGAL::Polygon_2<Kernel> Polygon_2;
         typedef CGAL::Polygon_set_2<Kernel> Polygon_set_2;
 
+        struct State
+        {
+                std::mutex mutex;
+                bool has_components;
+                std::vector<Polygon_with_holes_2> components;
+                std::shared_ptr<const Polygon_set_2> set;
+                std::shared_ptr<const EdgeGrid> grid;
+                bool has_hash;
+                std::uint64_t hash;
+        };
+
+        enum Operation
+        {
+                JOIN,
+                INTERSECTION,
+                DIFFERENCE
+        };
+
+        explicit Object2d(std::vector<Polygon_with_holes_2> &&components);
+        explicit Object2d(const std::shared_ptr<const Polygon_set_2> &set);
+
+        const std::vector<Polygon_with_holes_2> &components() const;
+        std::shared_ptr<const Polygon_set_2> polygon_set() const;
+        std::shared_ptr<const EdgeGrid> edge_grid() const;
+        int contains_exact(const Point_2 &point) const;
+
+        std::vector<const Polygon_2 *> rings() const;
+        // before the coordinates are shared with other threads, see DiffReal
+        void make_exact() const;
+
+        static Object2d rectangle2(const DiffReal &width, const DiffReal &height);
+        static Object2d circle2(const DiffReal &radius, std::size_t segments);
+        static Object2d arc2(const DiffReal &radius, double start, double angle, std::size_t segments,
+                             const DiffReal &inner_radius);
+        static Object2d rounded_rectangle2(const DiffReal &width, const DiffReal &height,
+                                           const DiffReal &radius, std::size_t segments);
         Object2d transform(Aff_Transformation_2 trans) const;
+        Object2d simplify_components(double epsilon) const;
+        Object2d auto_snap() const;
+        static bool snap_ring(const Polygon_2 &ring, double grid, Polygon_2 &result);
+        static bool snap_component(const Polygon_with_holes_2 &component, double grid, Polygon_with_holes_2 &result);
+        static std::size_t bit_size(const std::vector<Polygon_with_holes_2> &components);
         static Polygon_2 simplify2(const Polygon_2 &polygon, double epsilon);
-
-        std::vector<Polygon_with_holes_2> components;
+        static Point_2 detached(const Point_2 &point);
+        static Polygon_2 detached(const Polygon_2 &polygon);
+        static Object2d finish(const ArenaScope &scope, const std::shared_ptr<Polygon_set_2> &set);
+
+        template <typename Key, typename Compute>
+        static Object2d memoize(std::initializer_list<const Object2d *> operands, Key key, Compute compute);
+        bool same_content(const Object2d &other) const;
+        Object2d memoized_boolean(const Object2d &other, Operation operation, bool reuse) const;
+        Object2d boolean(const Object2d &other, Operation operation, bool reuse) const;
+        bool is_set_backed() const;
+        std::shared_ptr<Polygon_set_2> release_set() const;
+        static void apply(Polygon_set_2 &set, const Polygon_set_2 &other, Operation operation);
+        static std::vector<std::size_t> clusters(const std::vector<CGAL::Bbox_2> &boxes);
+
+        std::shared_ptr<State> d_state;
 
         friend class Mesh2d;
 };
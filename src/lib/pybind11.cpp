@@ -20,25 +20,133 @@
 #include "diffreal.hpp"
 #include "object2d.hpp"
 #include "mesh2d.hpp"
+#include "tape.hpp"
+#include "simd.hpp"
+#include "arena.hpp"
+#include "threadpool.hpp"
+#include "recipe.hpp"
+#include "stats.hpp"
 
+#include <algorithm>
 #include <CGAL/version.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
+#include <pybind11/numpy.h>
 
 namespace py = pybind11;
 
-PYBIND11_MODULE(_diffmesh, m)
+// hands the vector over to numpy without copying, a capsule owns the data
+template <typename T>
+static py::array_t<T> to_array(std::vector<T> &&data, const std::vector<py::ssize_t> &shape)
+{
+    StatsScope stats("python.convert");
+    auto *owner = new std::vector<T>(std::move(data));
+    py::capsule capsule(owner, [](void *p)
+                        { delete static_cast<std::vector<T> *>(p); });
+    return py::array_t<T>(shape, owner->data(), capsule);
+}
+
+// builds the python list under a timer, the automatic conversions are not timed
+template <typename T>
+static py::list to_list(const std::vector<T> &data)
+{
+    StatsScope stats("python.convert");
+    py::list result(data.size());
+    for (std::size_t i = 0; i < data.size(); i++)
+        result[i] = py::cast(data[i]);
+    return result;
+}
+
+// whether the segments are given by the tolerance or the edge length
+static bool auto_segments(const DiffReal &radius, double tolerance, double edge_length)
+{
+    return (tolerance > 0.0 || edge_length > 0.0) && radius.get_value() > 0.0;
+}
+
+// the fast kernel is built into a second module, so both can be loaded
+#ifdef DIFFMESH_FAST_KERNEL
+#define DIFFMESH_MODULE _diffmesh_fast
+#else
+#define DIFFMESH_MODULE _diffmesh
+#endif
+
+PYBIND11_MODULE(DIFFMESH_MODULE, m)
 {
     m.doc() = "diffmesh C++ backend";
     m.attr("CGAL_VERSION_STR") = CGAL_VERSION_STR;
+#ifdef DIFFMESH_LAZY_EXACT
+    m.attr("LAZY_EXACT") = true;
+#else
+    m.attr("LAZY_EXACT") = false;
+#endif
+#ifdef DIFFMESH_FAST_KERNEL
+    m.attr("FAST_KERNEL") = true;
+#else
+    m.attr("FAST_KERNEL") = false;
+#endif
+    m.attr("SIMD_LEVEL") = simd_kernels().name;
+
+    m.def("set_arena", &Arena::set_enabled, py::arg("enabled"), py::arg("chunk_size") = 1 << 20);
+    m.def("arena_stats", []()
+          {
+            Arena::Stats stats = Arena::get_stats();
+            py::dict result;
+            result["scopes"] = stats.scopes;
+            result["chunks"] = stats.chunks;
+            result["peak_size"] = stats.peak_size;
+            result["total_size"] = stats.total_size;
+            return result; });
+    m.def("reset_arena_stats", &Arena::reset_stats);
+
+    m.def("set_num_threads", &ThreadPool::set_num_threads, py::arg("num_threads"));
+    m.def("get_num_threads", &ThreadPool::get_num_threads);
+
+    m.def("set_memo", &Object2d::set_memo_capacity, py::arg("capacity"));
+    m.def("memo_stats", []()
+          {
+            MemoStats stats = Object2d::memo_stats();
+            py::dict result;
+            result["hits"] = stats.hits;
+            result["misses"] = stats.misses;
+            result["size"] = stats.size;
+            result["capacity"] = stats.capacity;
+            return result; });
+    m.def("reset_memo_stats", &Object2d::reset_memo_stats);
+    m.def("clear_memo", &Object2d::clear_memo);
+
+    m.def("set_stats", &Stats::set_enabled, py::arg("enabled"));
+    m.def("stats", []()
+          {
+            py::dict result;
+            result["enabled"] = Stats::is_enabled();
+            for (int i = 0; i < Stats::NUM_COUNTERS; i++)
+            {
+                Stats::Counter counter = static_cast<Stats::Counter>(i);
+                result[Stats::counter_name(counter)] = Stats::get_counter(counter);
+            }
+            result["max_bits"] = Stats::max_bits();
+            py::dict timers;
+            for (const auto &entry : Stats::get_timers())
+            {
+                py::dict timer;
+                timer["count"] = entry.second.count;
+                timer["seconds"] = entry.second.seconds;
+                timers[py::str(entry.first)] = timer;
+            }
+            result["timers"] = timers;
+            return result; });
+    m.def("reset_stats", &Stats::reset);
+    m.def("write_trace", &Stats::write_trace, py::arg("path"));
 
     py::class_<DiffReal, std::shared_ptr<DiffReal>>(m, "DiffReal")
         .def(py::init())
         .def(py::init<double>(), py::arg("value"))
         .def(py::init<double, std::vector<double>>(), py::arg("value"), py::arg("derivs"))
+        .def(py::init<double, std::vector<std::size_t>, std::vector<double>>(), py::arg("value"), py::arg("indices"), py::arg("derivs"))
         .def("value", &DiffReal::get_value)
         .def("derivs", static_cast<std::vector<double> (DiffReal::*)() const>(&DiffReal::get_derivs))
         .def("derivs", static_cast<std::vector<double> (DiffReal::*)(std::size_t) const>(&DiffReal::get_derivs))
+        .def("is_sparse", &DiffReal::is_sparse)
         .def("__eq__", &DiffReal::operator==, py::arg("other"))
         .def("__ne__", &DiffReal::operator!=, py::arg("other"))
         .def("__lt__", &DiffReal::operator<, py::arg("other"))
@@ -54,39 +162,218 @@ PYBIND11_MODULE(_diffmesh, m)
         .def("__isub__", &DiffReal::operator-=, py::arg("other"))
         .def("__imul__", &DiffReal::operator*=, py::arg("other"))
         .def("__idiv__", &DiffReal::operator/=, py::arg("other"))
-        .def("__repr__", &DiffReal::repr);
+        .def("__repr__", &DiffReal::repr)
+        .def_static("num_allocations", &Derivs::num_allocations);
+
+    py::class_<Tape, std::shared_ptr<Tape>>(m, "Tape")
+        .def(py::init())
+        .def("start", &Tape::start)
+        .def("stop", &Tape::stop)
+        .def("is_started", &Tape::is_started)
+        .def("clear", &Tape::clear)
+        .def("size", &Tape::size)
+        .def("variable", &Tape::variable, py::arg("value"))
+        .def("gradient", static_cast<std::vector<double> (Tape::*)(const std::vector<std::tuple<DiffReal, double>> &, std::size_t) const>(&Tape::gradient), py::arg("seeds"), py::arg("num_derivs"));
 
     py::class_<Object2d, std::shared_ptr<Object2d>>(m, "Object2d")
         .def(py::init())
         .def_static("polygon", &Object2d::polygon, py::arg("points"))
         .def_static("rectangle", &Object2d::rectangle, py::arg("width"), py::arg("height"))
-        .def_static("circle", &Object2d::circle, py::arg("radius"), py::arg("segments") = 24)
+        .def_static(
+            "circle", [](const DiffReal &radius, std::size_t segments, double tolerance, double edge_length)
+            {
+                if (auto_segments(radius, tolerance, edge_length))
+                    segments = Object2d::circle_segments(radius.get_value(), tolerance, edge_length);
+                return Object2d::circle(radius, segments); },
+            py::arg("radius"), py::arg("segments") = 24, py::arg("tolerance") = 0.0, py::arg("edge_length") = 0.0)
+        .def_static(
+            "arc", [](const DiffReal &radius, double start, double angle, std::size_t segments,
+                      double tolerance, double edge_length, const DiffReal &inner_radius)
+            {
+                if (auto_segments(radius, tolerance, edge_length))
+                    segments = Object2d::arc_segments(radius.get_value(), angle, tolerance, edge_length);
+                return Object2d::arc(radius, start, angle, segments, inner_radius); },
+            py::arg("radius"), py::arg("start"), py::arg("angle"), py::arg("segments") = 6,
+            py::arg("tolerance") = 0.0, py::arg("edge_length") = 0.0, py::arg("inner_radius") = DiffReal(0.0))
+        .def_static(
+            "rounded_rectangle", [](const DiffReal &width, const DiffReal &height, const DiffReal &radius,
+                                    std::size_t segments, double tolerance, double edge_length)
+            {
+                if (auto_segments(radius, tolerance, edge_length))
+                    segments = Object2d::corner_segments(radius.get_value(), tolerance, edge_length);
+                return Object2d::rounded_rectangle(width, height, radius, segments); },
+            py::arg("width"), py::arg("height"), py::arg("radius"), py::arg("segments") = 4,
+            py::arg("tolerance") = 0.0, py::arg("edge_length") = 0.0)
+        .def_static("arc_segments", &Object2d::arc_segments, py::arg("radius"), py::arg("angle"),
+                    py::arg("tolerance") = 0.0, py::arg("edge_length") = 0.0)
         .def("num_components", &Object2d::num_components)
         .def("num_polygons", &Object2d::num_polygons)
         .def("num_vertices", &Object2d::num_vertices)
         .def("bbox", &Object2d::bbox)
         .def("get_component", &Object2d::get_component, py::arg("index"))
         .def("get_polygon", &Object2d::get_polygon, py::arg("index"))
-        .def("get_vertices", &Object2d::get_vertices)
+        .def("get_vertices", [](const Object2d &self)
+             { return to_list(self.get_vertices()); })
+        .def("num_derivs", &Object2d::num_derivs)
+        .def("ring_offsets_array", [](const Object2d &self)
+             {
+                std::vector<std::int64_t> offsets = self.ring_offsets();
+                py::ssize_t size = offsets.size();
+                return to_array(std::move(offsets), {size}); })
+        .def("values_array", [](const Object2d &self)
+             {
+                std::vector<double> values;
+                {
+                    py::gil_scoped_release release;
+                    values = self.vertex_values();
+                }
+                py::ssize_t count = values.size() / 2;
+                return to_array(std::move(values), {count, 2}); })
+        .def(
+            "derivs_array", [](const Object2d &self, std::size_t num_derivs)
+            {
+                std::vector<double> derivs;
+                {
+                    py::gil_scoped_release release;
+                    derivs = self.vertex_derivs(num_derivs);
+                }
+                py::ssize_t count = num_derivs != 0 ? derivs.size() / (2 * num_derivs) : self.num_vertices();
+                return to_array(std::move(derivs), {count, 2, static_cast<py::ssize_t>(num_derivs)}); },
+            py::arg("num_derivs"))
         .def("translate", static_cast<Object2d (Object2d::*)(const DiffReal &, const DiffReal &) const>(&Object2d::translate), py::arg("xdiff"), py::arg("ydiff"))
         .def("translate", static_cast<Object2d (Object2d::*)(double, double) const>(&Object2d::translate), py::arg("xdiff"), py::arg("ydiff"))
         .def("rotate", static_cast<Object2d (Object2d::*)(const DiffReal &) const>(&Object2d::rotate), py::arg("angle"))
         .def("rotate", static_cast<Object2d (Object2d::*)(double) const>(&Object2d::rotate), py::arg("angle"))
         .def("scale", static_cast<Object2d (Object2d::*)(const DiffReal &) const>(&Object2d::scale), py::arg("scale"))
         .def("scale", static_cast<Object2d (Object2d::*)(double) const>(&Object2d::scale), py::arg("scale"))
-        .def("join", &Object2d::join, py::arg("other"))
-        .def("intersection", &Object2d::intersection, py::arg("other"))
-        .def("difference", &Object2d::difference, py::arg("other"))
+        .def("join", static_cast<Object2d (Object2d::*)(const Object2d &) const &>(&Object2d::join), py::arg("other"))
+        .def("intersection", static_cast<Object2d (Object2d::*)(const Object2d &) const &>(&Object2d::intersection), py::arg("other"))
+        .def("difference", static_cast<Object2d (Object2d::*)(const Object2d &) const &>(&Object2d::difference), py::arg("other"))
         .def("simplify", &Object2d::simplify, py::arg("epsilon") = 0.001)
+        .def("snap", &Object2d::snap, py::arg("grid"))
+        .def("snap_bits", &Object2d::snap_bits, py::arg("bits"))
         .def("contains", &Object2d::contains, py::arg("point"))
+        .def(
+            "contains_many", [](const Object2d &self, py::array_t<double, py::array::c_style | py::array::forcecast> points)
+            {
+                if (points.ndim() != 2 || points.shape(1) != 2)
+                    throw std::invalid_argument("points must be an N x 2 array");
+
+                std::size_t count = points.shape(0);
+                py::array_t<int> result(count);
+                const double *coords = points.data();
+                int *output = result.mutable_data();
+                {
+                    py::gil_scoped_release release;
+                    self.contains_many(coords, count, output);
+                }
+                return result; },
+            py::arg("points"))
+        .def("contains_many", static_cast<std::vector<int> (Object2d::*)(const std::vector<std::tuple<DiffReal, DiffReal>> &) const>(&Object2d::contains_many), py::arg("points"))
+        .def("save", &Object2d::save, py::arg("path"), py::arg("exact") = false)
+        .def_static("load", &Object2d::load, py::arg("path"))
+        .def("hash", &Object2d::hash)
+        .def_static("set_persistent", &Object2d::set_persistent, py::arg("enabled"))
+        .def_static("is_persistent", &Object2d::is_persistent)
+        .def_static("set_snap", &Object2d::set_snap, py::arg("grid") = 0.0, py::arg("bits") = 0)
         .def("__repr__", &Object2d::repr);
 
     py::class_<Mesh2d, std::shared_ptr<Mesh2d>>(m, "Mesh2d")
         .def(py::init<const Object2d &>(), py::arg("object"))
-        .def("refine_delaunay", &Mesh2d::refine_delaunay, py::arg("aspect_bound") = 0.125, py::arg("size_bound") = 0.0)
-        .def("lloyd_optimize", &Mesh2d::lloyd_optimize, py::arg("max_iteration_number") = 0)
+        .def("refine_delaunay", &Mesh2d::refine_delaunay, py::arg("aspect_bound") = 0.125, py::arg("size_bound") = 0.0, py::arg("num_strips") = 1)
+        .def("lloyd_optimize", &Mesh2d::lloyd_optimize, py::arg("max_iteration_number") = 0, py::arg("convergence") = 0.001, py::arg("odt") = false)
+        .def("reevaluate", &Mesh2d::reevaluate, py::arg("object"), py::arg("delta"))
         .def("num_vertices", &Mesh2d::num_vertices)
         .def("num_faces", &Mesh2d::num_faces)
-        .def("vertices", &Mesh2d::vertices)
-        .def("faces", &Mesh2d::faces);
+        .def("vertices", [](const Mesh2d &self)
+             { return to_list(self.vertices()); })
+        .def("faces", [](const Mesh2d &self)
+             { return to_list(self.faces()); })
+        .def("save", &Mesh2d::save, py::arg("path"), py::arg("exact") = false)
+        .def("write_vtu", &Mesh2d::write_vtu, py::arg("path"), py::arg("num_derivs") = 0)
+        .def("write_gmsh", &Mesh2d::write_gmsh, py::arg("path"))
+        .def("write_obj", &Mesh2d::write_obj, py::arg("path"))
+        .def("timings", &Mesh2d::timings)
+        .def("num_derivs", &Mesh2d::num_derivs)
+        // the mesh readers keep the GIL, since refine_delaunay and reevaluate
+        // may change the mesh from another Python thread meanwhile
+        .def("adjacency_arrays", [](const Mesh2d &self)
+             {
+                std::vector<std::int64_t> offsets, neighbors;
+                self.adjacency(offsets, neighbors);
+                py::ssize_t rows = offsets.size();
+                py::ssize_t size = neighbors.size();
+                return py::make_tuple(to_array(std::move(offsets), {rows}), to_array(std::move(neighbors), {size})); })
+        .def("boundary_array", [](const Mesh2d &self)
+             {
+                std::vector<std::uint8_t> markers = self.boundary_markers();
+                py::ssize_t count = markers.size();
+                return to_array(std::move(markers), {count}); })
+        .def(
+            "diffuse", [](const Mesh2d &self, std::size_t iterations, std::size_t num_derivs)
+            {
+                std::vector<double> points = self.diffuse(iterations, num_derivs);
+                py::ssize_t count = self.num_vertices();
+                return to_array(std::move(points), {count, 2, static_cast<py::ssize_t>(1 + num_derivs)}); },
+            py::arg("iterations") = 100, py::arg("num_derivs") = 0)
+        .def("values_array", [](const Mesh2d &self)
+             {
+                std::vector<double> values = self.vertex_values();
+                py::ssize_t count = values.size() / 2;
+                return to_array(std::move(values), {count, 2}); })
+        .def("faces_array", [](const Mesh2d &self)
+             {
+                std::vector<std::int64_t> faces = self.face_indices();
+                py::ssize_t count = faces.size() / 3;
+                return to_array(std::move(faces), {count, 3}); })
+        .def(
+            "derivs_array", [](const Mesh2d &self, std::size_t num_derivs)
+            {
+                std::vector<double> derivs = self.vertex_derivs(num_derivs);
+                py::ssize_t count = self.num_vertices();
+                return to_array(std::move(derivs), {count, 2, static_cast<py::ssize_t>(num_derivs)}); },
+            py::arg("num_derivs"))
+        .def("gradient", &Mesh2d::gradient, py::arg("tape"), py::arg("adjoints"), py::arg("num_derivs"));
+
+    py::class_<Recipe>(m, "Recipe")
+        .def(py::init<>())
+        .def("parameter", &Recipe::parameter, py::arg("index"))
+        .def("constant", &Recipe::constant, py::arg("value"))
+        .def("add", &Recipe::add, py::arg("a"), py::arg("b"))
+        .def("sub", &Recipe::sub, py::arg("a"), py::arg("b"))
+        .def("mul", &Recipe::mul, py::arg("a"), py::arg("b"))
+        .def("div", &Recipe::div, py::arg("a"), py::arg("b"))
+        .def("polygon", &Recipe::polygon, py::arg("coords"))
+        .def("rectangle", &Recipe::rectangle, py::arg("width"), py::arg("height"))
+        .def("circle", &Recipe::circle, py::arg("radius"), py::arg("segments") = 24)
+        .def("translate", &Recipe::translate, py::arg("object"), py::arg("xdiff"), py::arg("ydiff"))
+        .def("rotate", &Recipe::rotate, py::arg("object"), py::arg("angle"))
+        .def("scale", &Recipe::scale, py::arg("object"), py::arg("scale"))
+        .def("join", &Recipe::join, py::arg("a"), py::arg("b"))
+        .def("intersection", &Recipe::intersection, py::arg("a"), py::arg("b"))
+        .def("difference", &Recipe::difference, py::arg("a"), py::arg("b"))
+        .def("set_output", &Recipe::set_output, py::arg("object"))
+        .def("set_refine", &Recipe::set_refine, py::arg("aspect_bound") = 0.125, py::arg("size_bound") = 0.0)
+        .def("num_registers", &Recipe::num_registers)
+        .def("num_parameters", &Recipe::num_parameters)
+        .def(
+            "evaluate", [](const Recipe &self, const std::vector<double> &params)
+            { return self.evaluate(params.data(), params.size()); },
+            py::arg("params"))
+        .def(
+            "sweep", [](const Recipe &self, py::array_t<double, py::array::c_style | py::array::forcecast> params)
+            {
+                if (params.ndim() != 2)
+                    throw std::invalid_argument("params must be an N x P array");
+
+                std::size_t count = params.shape(0);
+                std::size_t num_params = params.shape(1);
+                const double *data = params.data();
+                std::vector<std::shared_ptr<Mesh2d>> meshes;
+                {
+                    py::gil_scoped_release release;
+                    meshes = self.sweep(data, count, num_params);
+                }
+                return meshes; },
+            py::arg("params"));
 }
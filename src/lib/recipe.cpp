@@ -0,0 +1,287 @@
+/*
+ * Copyright 2023 Miklos Maroti.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include "recipe.hpp"
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+// the first num_objects arguments are objects, the rest are numbers
+std::size_t Recipe::push(Operation operation, bool is_object, double value,
+                         const std::vector<std::size_t> &args, std::size_t num_objects)
+{
+        for (std::size_t i = 0; i < args.size(); i++)
+        {
+                if (args[i] >= d_steps.size())
+                        throw std::invalid_argument("invalid register");
+                if (d_steps[args[i]].is_object != (i < num_objects))
+                        throw std::invalid_argument(i < num_objects ? "register is not an object"
+                                                                    : "register is not a number");
+        }
+
+        d_steps.push_back({operation, is_object, value, args});
+        return d_steps.size() - 1;
+}
+
+std::size_t Recipe::parameter(std::size_t index)
+{
+        return push(PARAMETER, false, static_cast<double>(index), {}, 0);
+}
+
+std::size_t Recipe::constant(double value)
+{
+        return push(CONSTANT, false, value, {}, 0);
+}
+
+std::size_t Recipe::add(std::size_t a, std::size_t b)
+{
+        return push(ADD, false, 0.0, {a, b}, 0);
+}
+
+std::size_t Recipe::sub(std::size_t a, std::size_t b)
+{
+        return push(SUB, false, 0.0, {a, b}, 0);
+}
+
+std::size_t Recipe::mul(std::size_t a, std::size_t b)
+{
+        return push(MUL, false, 0.0, {a, b}, 0);
+}
+
+std::size_t Recipe::div(std::size_t a, std::size_t b)
+{
+        return push(DIV, false, 0.0, {a, b}, 0);
+}
+
+std::size_t Recipe::polygon(const std::vector<std::size_t> &coords)
+{
+        if (coords.size() < 6 || coords.size() % 2 != 0)
+                throw std::invalid_argument("polygon needs at least three points");
+        return push(POLYGON, true, 0.0, coords, 0);
+}
+
+std::size_t Recipe::rectangle(std::size_t width, std::size_t height)
+{
+        return push(RECTANGLE, true, 0.0, {width, height}, 0);
+}
+
+std::size_t Recipe::circle(std::size_t radius, std::size_t segments)
+{
+        if (segments < 3)
+                throw std::invalid_argument("invalid segments");
+        return push(CIRCLE, true, static_cast<double>(segments), {radius}, 0);
+}
+
+std::size_t Recipe::translate(std::size_t object, std::size_t xdiff, std::size_t ydiff)
+{
+        return push(TRANSLATE, true, 0.0, {object, xdiff, ydiff}, 1);
+}
+
+std::size_t Recipe::rotate(std::size_t object, std::size_t angle)
+{
+        return push(ROTATE, true, 0.0, {object, angle}, 1);
+}
+
+std::size_t Recipe::scale(std::size_t object, std::size_t scale)
+{
+        return push(SCALE, true, 0.0, {object, scale}, 1);
+}
+
+std::size_t Recipe::join(std::size_t a, std::size_t b)
+{
+        return push(JOIN, true, 0.0, {a, b}, 2);
+}
+
+std::size_t Recipe::intersection(std::size_t a, std::size_t b)
+{
+        return push(INTERSECTION, true, 0.0, {a, b}, 2);
+}
+
+std::size_t Recipe::difference(std::size_t a, std::size_t b)
+{
+        return push(DIFFERENCE, true, 0.0, {a, b}, 2);
+}
+
+void Recipe::set_output(std::size_t object)
+{
+        if (object >= d_steps.size() || !d_steps[object].is_object)
+                throw std::invalid_argument("register is not an object");
+        d_output = object;
+}
+
+void Recipe::set_refine(double aspect_bound, double size_bound)
+{
+        d_refine = true;
+        d_aspect_bound = aspect_bound;
+        d_size_bound = size_bound;
+}
+
+std::size_t Recipe::num_parameters() const
+{
+        std::size_t count = 0;
+        for (auto &s : d_steps)
+                if (s.operation == PARAMETER)
+                        count = std::max(count, static_cast<std::size_t>(s.value) + 1);
+        return count;
+}
+
+void Recipe::check_output() const
+{
+        for (auto &s : d_steps)
+                if (s.is_object)
+                        return;
+        throw std::logic_error("recipe has no object");
+}
+
+Object2d Recipe::evaluate(const double *params, std::size_t num_params) const
+{
+        check_output();
+        if (num_params < num_parameters())
+                throw std::invalid_argument("not enough parameters");
+
+        std::size_t output = d_output;
+        if (output == UNSET)
+                for (std::size_t i = 0; i < d_steps.size(); i++)
+                        if (d_steps[i].is_object)
+                                output = i;
+
+        // the step after which each register is not read any more
+        std::vector<std::size_t> last_use(d_steps.size(), 0);
+        for (std::size_t i = 0; i < d_steps.size(); i++)
+                for (std::size_t a : d_steps[i].args)
+                        last_use[a] = i;
+        last_use[output] = d_steps.size();
+
+        std::vector<Register> regs(d_steps.size());
+        for (std::size_t i = 0; i < d_steps.size(); i++)
+        {
+                const Step &s = d_steps[i];
+                auto num = [&regs, &s](std::size_t k) -> const DiffReal &
+                { return regs[s.args[k]].number; };
+                auto obj = [&regs, &s](std::size_t k) -> const Object2d &
+                { return regs[s.args[k]].object; };
+
+                // the left operand of a boolean is moved on its last read, so
+                // its polygon set can be reused by the result
+                auto take = [&regs, &s, &last_use, i]() -> Object2d
+                {
+                        std::size_t a = s.args[0];
+                        if (last_use[a] == i && s.args[1] != a)
+                                return std::move(regs[a].object);
+                        return regs[a].object;
+                };
+
+                switch (s.operation)
+                {
+                case PARAMETER:
+                {
+                        std::size_t index = static_cast<std::size_t>(s.value);
+                        regs[i].number = DiffReal(params[index], {index}, {1.0});
+                        break;
+                }
+                case CONSTANT:
+                        regs[i].number = DiffReal(s.value);
+                        break;
+                case ADD:
+                        regs[i].number = num(0) + num(1);
+                        break;
+                case SUB:
+                        regs[i].number = num(0) - num(1);
+                        break;
+                case MUL:
+                        regs[i].number = num(0) * num(1);
+                        break;
+                case DIV:
+                        regs[i].number = num(0) / num(1);
+                        break;
+                case POLYGON:
+                {
+                        std::vector<std::tuple<DiffReal, DiffReal>> points;
+                        for (std::size_t k = 0; k + 1 < s.args.size(); k += 2)
+                                points.emplace_back(num(k), num(k + 1));
+                        regs[i].object = Object2d::polygon(points);
+                        break;
+                }
+                case RECTANGLE:
+                        regs[i].object = Object2d::rectangle(num(0), num(1));
+                        break;
+                case CIRCLE:
+                        regs[i].object = Object2d::circle(num(0), static_cast<std::size_t>(s.value));
+                        break;
+                case TRANSLATE:
+                        regs[i].object = obj(0).translate(num(1), num(2));
+                        break;
+                case ROTATE:
+                        regs[i].object = obj(0).rotate(num(1));
+                        break;
+                case SCALE:
+                        regs[i].object = obj(0).scale(num(1));
+                        break;
+                case JOIN:
+                        regs[i].object = take().join(obj(1));
+                        break;
+                case INTERSECTION:
+                        regs[i].object = take().intersection(obj(1));
+                        break;
+                case DIFFERENCE:
+                        regs[i].object = take().difference(obj(1));
+                        break;
+                }
+        }
+
+        Object2d result = regs[output].object;
+        if (result.in_arena())
+                return result.detached();
+        return result;
+}
+
+std::vector<std::shared_ptr<Mesh2d>> Recipe::sweep(const double *params, std::size_t count,
+                                                   std::size_t num_params) const
+{
+        check_output();
+        if (num_params < num_parameters())
+                throw std::invalid_argument("not enough parameters");
+
+        std::vector<std::shared_ptr<Mesh2d>> meshes(count);
+        auto build = [&](std::size_t row)
+        {
+                // the registers of a replay die with its arena, the result is detached;
+                // the mesh is built outside, so its own scopes detach its points
+                Object2d object;
+                {
+                        ArenaScope scope;
+                        object = evaluate(params + row * num_params, num_params);
+                }
+                auto mesh = std::make_shared<Mesh2d>(object);
+                if (d_refine)
+                        mesh->refine_delaunay(d_aspect_bound, d_size_bound);
+                meshes[row] = mesh;
+        };
+
+        // the tape is thread local, so recorded operations must stay on this thread
+        if (Tape::current() == nullptr)
+                ThreadPool::global()->parallel_for(count, build);
+        else
+                for (std::size_t row = 0; row < count; row++)
+                        build(row);
+
+        return meshes;
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2023 Miklos Maroti.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef RECIPE_HPP
+#define RECIPE_HPP
+
+#include "diffreal.hpp"
+#include "object2d.hpp"
+#include "mesh2d.hpp"
+
+#include <memory>
+#include <vector>
+
+/*
+ * Construction steps of a parametric object, recorded once and replayed
+ * for many parameter vectors. Every step writes a new register that holds
+ * either a number or an object, and returns its index. The replays are
+ * independent, so a sweep runs them concurrently on the thread pool.
+ */
+class Recipe
+{
+public:
+        Recipe() : d_output(UNSET), d_refine(false), d_aspect_bound(0.125), d_size_bound(0.0) {}
+
+        // the given entry of the parameter vector, with unit derivative
+        std::size_t parameter(std::size_t index);
+        std::size_t constant(double value);
+
+        std::size_t add(std::size_t a, std::size_t b);
+        std::size_t sub(std::size_t a, std::size_t b);
+        std::size_t mul(std::size_t a, std::size_t b);
+        std::size_t div(std::size_t a, std::size_t b);
+
+        // polygon from the registers x0, y0, x1, y1, ...
+        std::size_t polygon(const std::vector<std::size_t> &coords);
+        std::size_t rectangle(std::size_t width, std::size_t height);
+        std::size_t circle(std::size_t radius, std::size_t segments = 24);
+
+        std::size_t translate(std::size_t object, std::size_t xdiff, std::size_t ydiff);
+        std::size_t rotate(std::size_t object, std::size_t angle);
+        std::size_t scale(std::size_t object, std::size_t scale);
+
+        std::size_t join(std::size_t a, std::size_t b);
+        std::size_t intersection(std::size_t a, std::size_t b);
+        std::size_t difference(std::size_t a, std::size_t b);
+
+        // the object that is meshed, the last object register by default
+        void set_output(std::size_t object);
+        void set_refine(double aspect_bound, double size_bound);
+
+        std::size_t num_registers() const { return d_steps.size(); }
+        std::size_t num_parameters() const;
+
+        Object2d evaluate(const double *params, std::size_t num_params) const;
+
+        // one mesh for each row of the count x num_params array, in order
+        std::vector<std::shared_ptr<Mesh2d>> sweep(const double *params, std::size_t count,
+                                                   std::size_t num_params) const;
+
+protected:
+        static const std::size_t UNSET = static_cast<std::size_t>(-1);
+
+        enum Operation
+        {
+                PARAMETER,
+                CONSTANT,
+                ADD,
+                SUB,
+                MUL,
+                DIV,
+                POLYGON,
+                RECTANGLE,
+                CIRCLE,
+                TRANSLATE,
+                ROTATE,
+                SCALE,
+                JOIN,
+                INTERSECTION,
+                DIFFERENCE
+        };
+
+        struct Step
+        {
+                Operation operation;
+                bool is_object;
+                double value;
+                std::vector<std::size_t> args;
+        };
+
+        struct Register
+        {
+                DiffReal number;
+                Object2d object;
+        };
+
+        std::size_t push(Operation operation, bool is_object, double value,
+                         const std::vector<std::size_t> &args, std::size_t num_objects);
+        void check_output() const;
+
+        std::vector<Step> d_steps;
+        std::size_t d_output;
+        bool d_refine;
+        double d_aspect_bound;
+        double d_size_bound;
+};
+
+#endif // RECIPE_HPP
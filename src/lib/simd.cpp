@@ -0,0 +1,211 @@
+/*
+ * Copyright 2023 Miklos Maroti.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "simd.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DIFFMESH_SIMD_X86
+#include <immintrin.h>
+#endif
+
+static void scalar_scale(double *y, double a, std::size_t n)
+{
+        for (std::size_t i = 0; i < n; i++)
+                y[i] *= a;
+}
+
+static void scalar_axpy(double *y, double a, const double *x, std::size_t n)
+{
+        for (std::size_t i = 0; i < n; i++)
+                y[i] += a * x[i];
+}
+
+static void scalar_scale_axpy(double *y, double b, double a, const double *x, std::size_t n)
+{
+        for (std::size_t i = 0; i < n; i++)
+                y[i] = b * y[i] + a * x[i];
+}
+
+static const SimdKernels scalar_kernels = {
+    "scalar", scalar_scale, scalar_axpy, scalar_scale_axpy};
+
+#ifdef DIFFMESH_SIMD_X86
+
+// multiplications and additions are kept separate (no FMA), so every level
+// produces bit identical results to the scalar loops
+
+__attribute__((target("sse2"))) static void sse2_scale(double *y, double a, std::size_t n)
+{
+        __m128d va = _mm_set1_pd(a);
+        std::size_t i = 0;
+        for (; i + 2 <= n; i += 2)
+                _mm_storeu_pd(y + i, _mm_mul_pd(va, _mm_loadu_pd(y + i)));
+        for (; i < n; i++)
+                y[i] *= a;
+}
+
+__attribute__((target("sse2"))) static void sse2_axpy(double *y, double a, const double *x, std::size_t n)
+{
+        __m128d va = _mm_set1_pd(a);
+        std::size_t i = 0;
+        for (; i + 2 <= n; i += 2)
+                _mm_storeu_pd(y + i, _mm_add_pd(_mm_loadu_pd(y + i), _mm_mul_pd(va, _mm_loadu_pd(x + i))));
+        for (; i < n; i++)
+                y[i] += a * x[i];
+}
+
+__attribute__((target("sse2"))) static void sse2_scale_axpy(double *y, double b, double a, const double *x, std::size_t n)
+{
+        __m128d va = _mm_set1_pd(a);
+        __m128d vb = _mm_set1_pd(b);
+        std::size_t i = 0;
+        for (; i + 2 <= n; i += 2)
+                _mm_storeu_pd(y + i, _mm_add_pd(_mm_mul_pd(vb, _mm_loadu_pd(y + i)),
+                                                _mm_mul_pd(va, _mm_loadu_pd(x + i))));
+        for (; i < n; i++)
+                y[i] = b * y[i] + a * x[i];
+}
+
+static const SimdKernels sse2_kernels = {
+    "sse2", sse2_scale, sse2_axpy, sse2_scale_axpy};
+
+__attribute__((target("avx2"))) static void avx2_scale(double *y, double a, std::size_t n)
+{
+        __m256d va = _mm256_set1_pd(a);
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+                _mm256_storeu_pd(y + i, _mm256_mul_pd(va, _mm256_loadu_pd(y + i)));
+        for (; i < n; i++)
+                y[i] *= a;
+}
+
+__attribute__((target("avx2"))) static void avx2_axpy(double *y, double a, const double *x, std::size_t n)
+{
+        __m256d va = _mm256_set1_pd(a);
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+                _mm256_storeu_pd(y + i, _mm256_add_pd(_mm256_loadu_pd(y + i),
+                                                      _mm256_mul_pd(va, _mm256_loadu_pd(x + i))));
+        for (; i < n; i++)
+                y[i] += a * x[i];
+}
+
+__attribute__((target("avx2"))) static void avx2_scale_axpy(double *y, double b, double a, const double *x, std::size_t n)
+{
+        __m256d va = _mm256_set1_pd(a);
+        __m256d vb = _mm256_set1_pd(b);
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+                _mm256_storeu_pd(y + i, _mm256_add_pd(_mm256_mul_pd(vb, _mm256_loadu_pd(y + i)),
+                                                      _mm256_mul_pd(va, _mm256_loadu_pd(x + i))));
+        for (; i < n; i++)
+                y[i] = b * y[i] + a * x[i];
+}
+
+static const SimdKernels avx2_kernels = {
+    "avx2", avx2_scale, avx2_axpy, avx2_scale_axpy};
+
+// the tails are handled with masked loads and stores
+
+__attribute__((target("avx512f"))) static void avx512_scale(double *y, double a, std::size_t n)
+{
+        __m512d va = _mm512_set1_pd(a);
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+                _mm512_storeu_pd(y + i, _mm512_mul_pd(va, _mm512_loadu_pd(y + i)));
+        if (i < n)
+        {
+                __mmask8 m = (__mmask8)((1u << (n - i)) - 1);
+                _mm512_mask_storeu_pd(y + i, m, _mm512_mul_pd(va, _mm512_maskz_loadu_pd(m, y + i)));
+        }
+}
+
+__attribute__((target("avx512f"))) static void avx512_axpy(double *y, double a, const double *x, std::size_t n)
+{
+        __m512d va = _mm512_set1_pd(a);
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+                _mm512_storeu_pd(y + i, _mm512_add_pd(_mm512_loadu_pd(y + i),
+                                                      _mm512_mul_pd(va, _mm512_loadu_pd(x + i))));
+        if (i < n)
+        {
+                __mmask8 m = (__mmask8)((1u << (n - i)) - 1);
+                _mm512_mask_storeu_pd(y + i, m, _mm512_add_pd(_mm512_maskz_loadu_pd(m, y + i),
+                                                              _mm512_mul_pd(va, _mm512_maskz_loadu_pd(m, x + i))));
+        }
+}
+
+__attribute__((target("avx512f"))) static void avx512_scale_axpy(double *y, double b, double a, const double *x, std::size_t n)
+{
+        __m512d va = _mm512_set1_pd(a);
+        __m512d vb = _mm512_set1_pd(b);
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+                _mm512_storeu_pd(y + i, _mm512_add_pd(_mm512_mul_pd(vb, _mm512_loadu_pd(y + i)),
+                                                      _mm512_mul_pd(va, _mm512_loadu_pd(x + i))));
+        if (i < n)
+        {
+                __mmask8 m = (__mmask8)((1u << (n - i)) - 1);
+                _mm512_mask_storeu_pd(y + i, m, _mm512_add_pd(_mm512_mul_pd(vb, _mm512_maskz_loadu_pd(m, y + i)),
+                                                              _mm512_mul_pd(va, _mm512_maskz_loadu_pd(m, x + i))));
+        }
+}
+
+static const SimdKernels avx512_kernels = {
+    "avx512", avx512_scale, avx512_axpy, avx512_scale_axpy};
+
+#endif // DIFFMESH_SIMD_X86
+
+static const SimdKernels &select_kernels()
+{
+        // highest level allowed by the environment: 0 scalar, 1 sse2, 2 avx2, 3 avx512
+        int level = 3;
+        const char *env = std::getenv("DIFFMESH_SIMD");
+        if (env != nullptr)
+        {
+                if (std::strcmp(env, "scalar") == 0)
+                        level = 0;
+                else if (std::strcmp(env, "sse2") == 0)
+                        level = 1;
+                else if (std::strcmp(env, "avx2") == 0)
+                        level = 2;
+        }
+
+#ifdef DIFFMESH_SIMD_X86
+        __builtin_cpu_init();
+        if (level >= 3 && __builtin_cpu_supports("avx512f"))
+                return avx512_kernels;
+        if (level >= 2 && __builtin_cpu_supports("avx2"))
+                return avx2_kernels;
+        if (level >= 1 && __builtin_cpu_supports("sse2"))
+                return sse2_kernels;
+#endif
+
+        (void)level;
+        return scalar_kernels;
+}
+
+const SimdKernels &simd_kernels()
+{
+        static const SimdKernels &kernels = select_kernels();
+        return kernels;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright 2023 Miklos Maroti.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef SIMD_HPP
+#define SIMD_HPP
+
+#include <cstddef>
+
+/*
+ * Vectorized kernels for the dense derivative updates. The implementation
+ * is selected once from the instruction sets the CPU supports (SSE2, AVX2
+ * or AVX-512 on x86, scalar loops elsewhere). The DIFFMESH_SIMD environment
+ * variable can force a lower level.
+ */
+struct SimdKernels
+{
+        const char *name;
+
+        // y = a * y
+        void (*scale)(double *y, double a, std::size_t n);
+
+        // y = y + a * x
+        void (*axpy)(double *y, double a, const double *x, std::size_t n);
+
+        // y = b * y + a * x
+        void (*scale_axpy)(double *y, double b, double a, const double *x, std::size_t n);
+};
+
+const SimdKernels &simd_kernels();
+
+#endif // SIMD_HPP
@@ -0,0 +1,227 @@
+/*
+ * Copyright 2023 Miklos Maroti.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include "stats.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+std::atomic<bool> Stats::s_enabled(false);
+
+// written only by the owner thread, read by anyone
+struct CounterBlock
+{
+        std::atomic<std::uint64_t> values[Stats::NUM_COUNTERS];
+};
+
+static std::mutex counters_mutex;
+static std::vector<CounterBlock *> counter_blocks;
+static std::uint64_t retired_counters[Stats::NUM_COUNTERS] = {};
+static std::uint64_t counter_baseline[Stats::NUM_COUNTERS] = {};
+
+static std::atomic<std::size_t> max_bit_size(0);
+
+// the block of a thread is registered on first use, its counts are kept
+// after the thread exits
+struct ThreadCounters
+{
+        CounterBlock block;
+
+        ThreadCounters()
+        {
+                for (auto &value : block.values)
+                        value.store(0, std::memory_order_relaxed);
+                std::lock_guard<std::mutex> lock(counters_mutex);
+                counter_blocks.push_back(&block);
+        }
+
+        ~ThreadCounters()
+        {
+                std::lock_guard<std::mutex> lock(counters_mutex);
+                for (int i = 0; i < Stats::NUM_COUNTERS; i++)
+                        retired_counters[i] += block.values[i].load(std::memory_order_relaxed);
+                counter_blocks.erase(std::find(counter_blocks.begin(), counter_blocks.end(), &block));
+        }
+};
+
+static thread_local ThreadCounters thread_counters;
+
+struct Event
+{
+        const char *name;
+        std::uint32_t thread;
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::time_point end;
+};
+
+static std::mutex events_mutex;
+static std::vector<Event> events;
+static std::map<std::string, Stats::Timer> timers;
+static std::chrono::steady_clock::time_point trace_origin = std::chrono::steady_clock::now();
+
+static std::atomic<std::uint32_t> thread_count(0);
+static thread_local std::uint32_t thread_id = thread_count.fetch_add(1);
+
+void Stats::set_enabled(bool enabled)
+{
+        s_enabled.store(enabled);
+}
+
+void Stats::add(Counter counter, std::uint64_t amount)
+{
+        std::atomic<std::uint64_t> &value = thread_counters.block.values[counter];
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+void Stats::record_bits(std::size_t bits)
+{
+        std::size_t current = max_bit_size.load(std::memory_order_relaxed);
+        while (bits > current && !max_bit_size.compare_exchange_weak(current, bits, std::memory_order_relaxed))
+                ;
+}
+
+void Stats::add_event(const char *name, std::chrono::steady_clock::time_point start,
+                      std::chrono::steady_clock::time_point end)
+{
+        std::lock_guard<std::mutex> lock(events_mutex);
+        Timer &timer = timers[name];
+        timer.count += 1;
+        timer.seconds += std::chrono::duration<double>(end - start).count();
+        if (events.size() < MAX_EVENTS)
+                events.push_back({name, thread_id, start, end});
+}
+
+const char *Stats::counter_name(Counter counter)
+{
+        switch (counter)
+        {
+        case VALUE_OPS:
+                return "value_ops";
+        case EXACT_PREDICATES:
+                return "exact_predicates";
+        case STEINER_POINTS:
+                return "steiner_points";
+        case SNAP_BITS_IN:
+                return "snap_bits_in";
+        case SNAP_BITS_OUT:
+                return "snap_bits_out";
+        case SNAP_FALLBACKS:
+                return "snap_fallbacks";
+        case DERIV_ALLOCATIONS:
+                return "deriv_allocations";
+        default:
+                throw std::invalid_argument("invalid counter");
+        }
+}
+
+static std::uint64_t counter_total(int counter)
+{
+        std::uint64_t total = retired_counters[counter];
+        for (CounterBlock *block : counter_blocks)
+                total += block->values[counter].load(std::memory_order_relaxed);
+        return total;
+}
+
+std::uint64_t Stats::get_counter(Counter counter)
+{
+        if (counter < 0 || counter >= NUM_COUNTERS)
+                throw std::invalid_argument("invalid counter");
+
+        std::lock_guard<std::mutex> lock(counters_mutex);
+        return counter_total(counter) - counter_baseline[counter];
+}
+
+std::size_t Stats::max_bits()
+{
+        return max_bit_size.load(std::memory_order_relaxed);
+}
+
+std::map<std::string, Stats::Timer> Stats::get_timers()
+{
+        std::lock_guard<std::mutex> lock(events_mutex);
+        return timers;
+}
+
+void Stats::reset()
+{
+        {
+                // the owners keep incrementing, so the totals are only rebased
+                std::lock_guard<std::mutex> lock(counters_mutex);
+                for (int i = 0; i < NUM_COUNTERS; i++)
+                        counter_baseline[i] = counter_total(i);
+        }
+        max_bit_size.store(0);
+
+        std::lock_guard<std::mutex> lock(events_mutex);
+        events.clear();
+        timers.clear();
+        trace_origin = std::chrono::steady_clock::now();
+}
+
+void Stats::write_trace(const std::string &path)
+{
+        std::vector<Event> copy;
+        std::chrono::steady_clock::time_point origin;
+        {
+                std::lock_guard<std::mutex> lock(events_mutex);
+                copy = events;
+                origin = trace_origin;
+        }
+
+        std::ofstream file(path);
+        if (!file)
+                throw std::runtime_error("could not open " + path);
+
+        auto micros = [origin](std::chrono::steady_clock::time_point time)
+        {
+                return std::chrono::duration<double, std::micro>(time - origin).count();
+        };
+
+        char buffer[256];
+        file << "{\"traceEvents\": [\n";
+        for (const Event &event : copy)
+        {
+                std::snprintf(buffer, sizeof(buffer),
+                              "{\"name\": \"%s\", \"cat\": \"diffmesh\", \"ph\": \"X\", \"pid\": 0, "
+                              "\"tid\": %u, \"ts\": %.3f, \"dur\": %.3f},\n",
+                              event.name, event.thread, micros(event.start), micros(event.end) - micros(event.start));
+                file << buffer;
+        }
+
+        // the counters at the end, as a single sample
+        double last = 0.0;
+        for (const Event &event : copy)
+                last = std::max(last, micros(event.end));
+        std::snprintf(buffer, sizeof(buffer),
+                      "{\"name\": \"counters\", \"ph\": \"C\", \"pid\": 0, \"tid\": 0, \"ts\": %.3f, \"args\": {",
+                      last);
+        file << buffer;
+        for (int i = 0; i < NUM_COUNTERS; i++)
+                file << "\"" << counter_name(static_cast<Counter>(i)) << "\": " << get_counter(static_cast<Counter>(i)) << ", ";
+        file << "\"max_bits\": " << max_bits() << "}}\n";
+        file << "], \"displayTimeUnit\": \"ms\"}\n";
+
+        if (!file)
+                throw std::runtime_error("could not write " + path);
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright 2023 Miklos Maroti.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+
+/*
+ * Process wide counters and stage timers of the pipeline, switched on and
+ * off at runtime. While disabled every probe is a relaxed load of a flag.
+ * Counters are kept per thread and summed when read, timed scopes are also
+ * recorded as events that can be written out as a Chrome trace (up to
+ * MAX_EVENTS of them, the totals keep counting after that).
+ */
+class Stats
+{
+public:
+        enum Counter
+        {
+                // arithmetic operations on DiffReal values (Gmpq operations
+                // unless the fast kernel is used)
+                VALUE_OPS,
+                // signs and comparisons of exact values, with the fast kernel
+                // the predicates that were not decided by the double filter
+                EXACT_PREDICATES,
+                // vertices inserted by the refinement
+                STEINER_POINTS,
+                // coordinate bit sizes before and after snapping, for the
+                // components that were snapped
+                SNAP_BITS_IN,
+                SNAP_BITS_OUT,
+                // components or objects that kept their coordinates, because
+                // snapping would have made them invalid
+                SNAP_FALLBACKS,
+                // heap (or arena) allocations of derivative vectors
+                DERIV_ALLOCATIONS,
+                NUM_COUNTERS
+        };
+
+        struct Timer
+        {
+                std::size_t count;
+                double seconds;
+        };
+
+        static const std::size_t MAX_EVENTS = 1 << 20;
+
+        static void set_enabled(bool enabled);
+        static bool is_enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+        static void count(Counter counter, std::uint64_t amount = 1)
+        {
+                if (is_enabled())
+                        add(counter, amount);
+        }
+
+        // largest numerator plus denominator bit length seen
+        static void record_bits(std::size_t bits);
+
+        static const char *counter_name(Counter counter);
+        static std::uint64_t get_counter(Counter counter);
+        static std::size_t max_bits();
+        static std::map<std::string, Timer> get_timers();
+
+        // zeroes the counters, timers and events
+        static void reset();
+
+        // Chrome trace event format, load it in chrome://tracing or Perfetto
+        static void write_trace(const std::string &path);
+
+protected:
+        static std::atomic<bool> s_enabled;
+
+        static void add(Counter counter, std::uint64_t amount);
+        static void add_event(const char *name, std::chrono::steady_clock::time_point start,
+                              std::chrono::steady_clock::time_point end);
+
+        friend class StatsScope;
+};
+
+/*
+ * Times the enclosing block under the given name, which must be a string
+ * literal. Nothing is recorded when the stats were disabled on entry.
+ */
+class StatsScope
+{
+public:
+        explicit StatsScope(const char *name)
+            : d_name(Stats::is_enabled() ? name : nullptr)
+        {
+                if (d_name != nullptr)
+                        d_start = std::chrono::steady_clock::now();
+        }
+
+        ~StatsScope()
+        {
+                if (d_name != nullptr)
+                        Stats::add_event(d_name, d_start, std::chrono::steady_clock::now());
+        }
+
+protected:
+        const char *d_name;
+        std::chrono::steady_clock::time_point d_start;
+
+        StatsScope(const StatsScope &) = delete;
+        StatsScope &operator=(const StatsScope &) = delete;
+};
+
+#endif // STATS_HPP
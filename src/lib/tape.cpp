@@ -0,0 +1,159 @@
+/*
+ * Copyright 2023 Miklos Maroti.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "tape.hpp"
+#include "diffreal.hpp"
+
+#include <atomic>
+#include <limits>
+#include <stdexcept>
+
+static thread_local Tape *current_tape = nullptr;
+static std::atomic<std::uint32_t> generation_count(0);
+
+Tape::Tape() : d_size(0), d_generation(0)
+{
+        clear();
+}
+
+Tape::~Tape()
+{
+        stop();
+}
+
+void Tape::start()
+{
+        if (current_tape != nullptr && current_tape != this)
+                throw std::logic_error("another tape is already started");
+        current_tape = this;
+}
+
+void Tape::stop()
+{
+        if (current_tape == this)
+                current_tape = nullptr;
+}
+
+void Tape::clear()
+{
+        d_blocks.clear();
+        d_arena.reset(new Arena(BLOCK_SIZE * sizeof(Entry), false));
+        d_variables.clear();
+        d_size = 0;
+
+        // values recorded before are not valid on the cleared tape
+        d_generation = generation_count.fetch_add(1) + 1;
+        if (d_generation == 0)
+                d_generation = generation_count.fetch_add(1) + 1;
+
+        // node 0 stands for all constants and is never propagated
+        push(0, 0.0, 0, 0.0);
+}
+
+DiffReal Tape::variable(const DiffReal &value)
+{
+        DiffReal result;
+        result.value = value.value;
+        result.node = push(0, 0.0, 0, 0.0);
+        d_variables.emplace_back(result.node, value.derivs);
+        return result;
+}
+
+std::vector<double> Tape::gradient(const std::vector<std::tuple<DiffReal, double>> &seeds,
+                                   std::size_t num_derivs) const
+{
+        std::vector<std::tuple<Node, double>> nodes;
+        nodes.reserve(seeds.size());
+        for (auto &s : seeds)
+                nodes.emplace_back(std::get<0>(s).node, std::get<1>(s));
+        return gradient(nodes, num_derivs);
+}
+
+std::vector<double> Tape::gradient(const std::vector<std::tuple<Node, double>> &seeds,
+                                   std::size_t num_derivs) const
+{
+        std::vector<double> adjoints(d_size, 0.0);
+        for (auto &s : seeds)
+                adjoints[index(std::get<0>(s))] += std::get<1>(s);
+
+        for (std::size_t i = d_size - 1; i > 0; i--)
+        {
+                double adjoint = adjoints[i];
+                if (adjoint == 0.0)
+                        continue;
+
+                const Entry &e = entry(i);
+                adjoints[e.parent[0]] += e.weight[0] * adjoint;
+                adjoints[e.parent[1]] += e.weight[1] * adjoint;
+        }
+
+        Derivs result;
+        for (auto &v : d_variables)
+                result.axpy(adjoints[index(std::get<0>(v))], std::get<1>(v));
+        return result.get_dense(num_derivs);
+}
+
+Tape *Tape::current()
+{
+        return current_tape;
+}
+
+Tape::Node Tape::record(Node a, double da, Node b, double db)
+{
+        Tape *tape = current_tape;
+        if (tape == nullptr)
+        {
+                if ((a | b) != 0)
+                        throw std::logic_error("recorded value is used while no tape is started");
+                return 0;
+        }
+        return tape->push(tape->index(a), da, tape->index(b), db);
+}
+
+Tape::Index Tape::index(Node node) const
+{
+        if (node == 0)
+                return 0;
+        if (static_cast<std::uint32_t>(node >> 32) != d_generation)
+                throw std::invalid_argument("value is not recorded on this tape");
+
+        Index i = static_cast<Index>(node);
+        if (i >= d_size)
+                throw std::invalid_argument("value is not recorded on this tape");
+        return i;
+}
+
+Tape::Node Tape::push(Index a, double da, Index b, double db)
+{
+        if (d_size > std::numeric_limits<Index>::max())
+                throw std::overflow_error("tape is full");
+
+        if (d_size % BLOCK_SIZE == 0)
+                d_blocks.push_back(static_cast<Entry *>(d_arena->allocate(BLOCK_SIZE * sizeof(Entry))));
+
+        Entry &e = entry(d_size);
+        e.parent[0] = a;
+        e.parent[1] = b;
+        e.weight[0] = da;
+        e.weight[1] = db;
+
+        // the constant entry keeps node 0 for every tape
+        Node index = d_size++;
+        return index == 0 ? 0 : (static_cast<Node>(d_generation) << 32) | index;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2023 Miklos Maroti.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef TAPE_HPP
+#define TAPE_HPP
+
+#include "derivs.hpp"
+#include "arena.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+class DiffReal;
+
+/*
+ * Reverse mode differentiation tape. While a tape is started on the
+ * current thread every DiffReal operation with a recorded operand appends
+ * a node with the local partial derivatives. Variables keep their forward
+ * derivatives on the tape instead of in the DiffReal, so the recorded
+ * computation carries no derivative vectors at all. Operations on recorded
+ * values while no tape is started throw, their derivatives would be lost.
+ */
+class Tape
+{
+public:
+        // the upper half identifies the tape and its contents, it changes with
+        // every clear, the lower half is the entry index; 0 stands for the
+        // constants of all tapes
+        typedef std::uint64_t Node;
+
+        Tape();
+        ~Tape();
+
+        void start();
+        void stop();
+        bool is_started() const { return current() == this; }
+        void clear();
+
+        std::size_t size() const { return d_size; }
+
+        DiffReal variable(const DiffReal &value);
+
+        std::vector<double> gradient(const std::vector<std::tuple<DiffReal, double>> &seeds,
+                                     std::size_t num_derivs) const;
+        std::vector<double> gradient(const std::vector<std::tuple<Node, double>> &seeds,
+                                     std::size_t num_derivs) const;
+
+        static Tape *current();
+        static Node record(Node a, double da, Node b, double db);
+
+protected:
+        static const std::size_t BLOCK_SIZE = 1 << 16;
+
+        typedef std::uint32_t Index;
+
+        struct Entry
+        {
+                Index parent[2];
+                double weight[2];
+        };
+
+        Entry &entry(Index index) const { return d_blocks[index / BLOCK_SIZE][index % BLOCK_SIZE]; }
+        Node push(Index a, double da, Index b, double db);
+
+        // the entry of a node, which must come from this tape since its last clear
+        Index index(Node node) const;
+
+        // the blocks are carved from an arena of the tape, which clear releases
+        std::unique_ptr<Arena> d_arena;
+        std::vector<Entry *> d_blocks;
+        std::size_t d_size;
+        std::uint32_t d_generation;
+
+        std::vector<std::tuple<Node, Derivs>> d_variables;
+};
+
+#endif // TAPE_HPP
@@ -0,0 +1,177 @@
+/*
+ * Copyright 2023 Miklos Maroti.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <exception>
+
+static std::mutex global_mutex;
+static std::shared_ptr<ThreadPool> global_pool;
+
+static std::size_t default_num_threads()
+{
+        const char *env = std::getenv("DIFFMESH_THREADS");
+        if (env != nullptr && std::atoi(env) > 0)
+                return std::atoi(env);
+
+        std::size_t n = std::thread::hardware_concurrency();
+        return n > 0 ? n : 1;
+}
+
+ThreadPool::ThreadPool(std::size_t num_threads) : d_stopping(false)
+{
+        for (std::size_t i = 1; i < num_threads; i++)
+                d_workers.emplace_back(&ThreadPool::run, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+        {
+                std::lock_guard<std::mutex> lock(d_mutex);
+                d_stopping = true;
+        }
+        d_wakeup.notify_all();
+
+        for (auto &t : d_workers)
+                t.join();
+}
+
+void ThreadPool::run()
+{
+        for (;;)
+        {
+                std::function<void()> job;
+                {
+                        std::unique_lock<std::mutex> lock(d_mutex);
+                        d_wakeup.wait(lock, [this]()
+                                      { return d_stopping || !d_jobs.empty(); });
+                        if (d_jobs.empty())
+                                return;
+
+                        job = std::move(d_jobs.front());
+                        d_jobs.pop_front();
+                }
+                job();
+        }
+}
+
+void ThreadPool::parallel_for(std::size_t count, const std::function<void(std::size_t)> &func)
+{
+        if (count == 0)
+                return;
+
+        if (count == 1 || d_workers.empty())
+        {
+                for (std::size_t i = 0; i < count; i++)
+                        func(i);
+                return;
+        }
+
+        struct Loop
+        {
+                std::atomic<std::size_t> next;
+                std::size_t done;
+                std::exception_ptr error;
+                std::mutex mutex;
+                std::condition_variable finished;
+        };
+
+        auto loop = std::make_shared<Loop>();
+        loop->next = 0;
+        loop->done = 0;
+
+        // helpers may start after the loop is over, then they find no work
+        auto work = [loop, count, &func]()
+        {
+                std::size_t completed = 0;
+                std::exception_ptr error;
+                for (;;)
+                {
+                        std::size_t i = loop->next.fetch_add(1);
+                        if (i >= count)
+                                break;
+
+                        try
+                        {
+                                func(i);
+                        }
+                        catch (...)
+                        {
+                                if (!error)
+                                        error = std::current_exception();
+                        }
+                        completed += 1;
+                }
+
+                if (completed == 0)
+                        return;
+
+                std::lock_guard<std::mutex> lock(loop->mutex);
+                if (error && !loop->error)
+                        loop->error = error;
+                loop->done += completed;
+                if (loop->done == count)
+                        loop->finished.notify_all();
+        };
+
+        std::size_t helpers = std::min(d_workers.size(), count - 1);
+        {
+                std::lock_guard<std::mutex> lock(d_mutex);
+                for (std::size_t i = 0; i < helpers; i++)
+                        d_jobs.push_back(work);
+        }
+        d_wakeup.notify_all();
+
+        work();
+
+        std::unique_lock<std::mutex> lock(loop->mutex);
+        loop->finished.wait(lock, [&]()
+                            { return loop->done == count; });
+
+        if (loop->error)
+                std::rethrow_exception(loop->error);
+}
+
+std::shared_ptr<ThreadPool> ThreadPool::global()
+{
+        std::lock_guard<std::mutex> lock(global_mutex);
+        if (global_pool == nullptr)
+                global_pool = std::make_shared<ThreadPool>(default_num_threads());
+        return global_pool;
+}
+
+void ThreadPool::set_num_threads(std::size_t num_threads)
+{
+        if (num_threads == 0)
+                num_threads = default_num_threads();
+
+        std::shared_ptr<ThreadPool> pool = std::make_shared<ThreadPool>(num_threads);
+
+        // loops still running keep the old pool alive until they finish
+        std::lock_guard<std::mutex> lock(global_mutex);
+        global_pool.swap(pool);
+}
+
+std::size_t ThreadPool::get_num_threads()
+{
+        return global()->num_threads();
+}
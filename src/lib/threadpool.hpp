@@ -0,0 +1,68 @@
+/*
+ * Copyright 2023 Miklos Maroti.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed set of worker threads for coarse grained parallel loops. The
+ * calling thread takes part in its own loop, so nested loops issued from
+ * a worker cannot deadlock. The global pool has one thread per core
+ * unless DIFFMESH_THREADS or set_num_threads says otherwise. Lazy exact
+ * values must be evaluated with make_exact before a loop shares them.
+ */
+class ThreadPool
+{
+public:
+        explicit ThreadPool(std::size_t num_threads);
+        ~ThreadPool();
+
+        // number of threads working on a loop, including the caller
+        std::size_t num_threads() const { return d_workers.size() + 1; }
+
+        // calls func(0), ..., func(count - 1) and rethrows the first exception
+        void parallel_for(std::size_t count, const std::function<void(std::size_t)> &func);
+
+        static std::shared_ptr<ThreadPool> global();
+        static void set_num_threads(std::size_t num_threads);
+        static std::size_t get_num_threads();
+
+protected:
+        void run();
+
+        std::vector<std::thread> d_workers;
+        std::deque<std::function<void()>> d_jobs;
+        std::mutex d_mutex;
+        std::condition_variable d_wakeup;
+        bool d_stopping;
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+};
+
+#endif // THREADPOOL_HPP
@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+# Copyright (C) 2023, Miklos Maroti
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+import time
+from diffmesh import Object2d, DiffReal, Mesh2d, Recipe, set_arena, arena_stats, \
+    set_num_threads, get_num_threads, set_stats
+
+# the derivative allocations are only counted while the stats are enabled
+set_stats(True)
+
+
+def param(value, index, num_derivs):
+    derivs = [0.0] * num_derivs
+    derivs[index] = 1.0
+    return DiffReal(value, derivs)
+
+
+def measure(name, func):
+    count = DiffReal.num_allocations()
+    start = time.perf_counter()
+    result = func()
+    print("{:<12} {:>10.4f} s {:>12} allocs".format(
+        name, time.perf_counter() - start,
+        DiffReal.num_allocations() - count))
+    return result
+
+
+# more derivatives than fit inline, so every temporary copy allocates
+for num_derivs, arena in [(4, False), (64, False), (64, True)]:
+    print("num_derivs", num_derivs, "arena", arena)
+    set_arena(arena)
+    width = param(10, 0, num_derivs)
+    radius = param(3, 1, num_derivs)
+
+    rect = Object2d.rectangle(width, width)
+    circle = Object2d.circle(radius, segments=64)
+    obj = measure("difference", lambda: rect.difference(
+        circle.translate(2, 1)).difference(circle.translate(-2, -1)))
+    mesh = measure("mesh", lambda: Mesh2d(obj))
+    measure("refine", lambda: mesh.refine_delaunay(size_bound=0.5))
+    print(mesh.timings())
+
+print(arena_stats())
+
+# long chains of booleans reuse the polygon set of the previous result
+set_arena(False)
+for persistent in [False, True]:
+    print("persistent", persistent)
+    Object2d.set_persistent(persistent)
+    circle = Object2d.circle(param(1, 0, 4), segments=32)
+
+    def chain():
+        obj = Object2d()
+        for i in range(40):
+            obj = obj.join(circle.translate(1.5 * i, 0.5 * (i % 2)))
+        return obj.num_vertices()
+
+    measure("chain", chain)
+Object2d.set_persistent(False)
+
+# disjoint islands are handled cluster by cluster on the thread pool
+for num_threads in [1, 0]:
+    set_num_threads(num_threads)
+    print("num_threads", get_num_threads())
+    square = Object2d.rectangle(param(2, 0, 4), param(2, 1, 4))
+    hole = Object2d.circle(param(0.5, 2, 4), segments=32)
+    islands = Object2d()
+    holes = Object2d()
+    for i in range(8):
+        for j in range(8):
+            islands = islands.join(square.translate(4 * i, 4 * j))
+            holes = holes.join(hole.translate(4 * i, 4 * j))
+    measure("islands", lambda: islands.difference(holes).num_vertices())
+
+# point classification with the edge grid
+import numpy
+set_num_threads(0)
+obj = Object2d.rectangle(param(10, 0, 4), param(10, 1, 4)).difference(
+    Object2d.circle(param(3, 2, 4), segments=64))
+points = numpy.random.default_rng(0).uniform(-6, 6, size=(1000000, 2))
+inside = measure("contains", lambda: obj.contains_many(points))
+print("inside", int(numpy.sum(inside == 1)), "of", len(points))
+
+# strips of the domain are refined in parallel, then stitched together
+obj = Object2d.rectangle(param(40, 0, 4), param(10, 1, 4)).difference(
+    Object2d.circle(param(3, 2, 4), segments=64))
+for num_strips in [1, 8]:
+    mesh = Mesh2d(obj)
+    measure("strips {}".format(num_strips),
+            lambda: mesh.refine_delaunay(size_bound=0.1, num_strips=num_strips))
+    print(mesh.num_vertices(), "vertices", mesh.timings())
+
+# independent builds of a parameter sweep run concurrently
+recipe = Recipe()
+plate = recipe.rectangle(recipe.parameter(0), recipe.parameter(1))
+hole = recipe.circle(recipe.parameter(2), 32)
+recipe.difference(plate, recipe.translate(hole, recipe.constant(1.0), recipe.constant(0.5)))
+recipe.set_refine(size_bound=0.5)
+params = numpy.column_stack([numpy.linspace(8, 12, 64), numpy.full(64, 10.0),
+                             numpy.linspace(1, 3, 64)])
+for num_threads in [1, 0]:
+    set_num_threads(num_threads)
+    meshes = measure("sweep {}".format(get_num_threads()), lambda: recipe.sweep(params))
+print(sum(mesh.num_vertices() for mesh in meshes), "vertices")
+
+# the same construction with double coordinates and filtered predicates,
+# when the package was built with DIFFMESH_FAST_KERNEL
+import diffmesh
+modules = [diffmesh]
+try:
+    import diffmesh.fast
+    modules.append(diffmesh.fast)
+except ImportError as error:
+    print(error)
+for module in modules:
+    print("fast kernel", module.FAST_KERNEL)
+    width = module.DiffReal(10, [1, 0, 0])
+    radius = module.DiffReal(3, [0, 1, 0])
+    plate = module.Object2d.rectangle(width, width)
+    hole = module.Object2d.circle(radius, segments=64)
+    obj = measure("fast difference", lambda: plate.difference(hole.translate(2, 1)))
+    mesh = measure("fast mesh", lambda: module.Mesh2d(obj))
+    measure("fast refine", lambda: mesh.refine_delaunay(size_bound=0.1))
+
+# the second run of an unchanged case maps the saved mesh instead of meshing
+import tempfile
+from diffmesh.meshcache import MeshCache
+obj = Object2d.rectangle(param(10, 0, 4), param(10, 1, 4)).difference(
+    Object2d.circle(param(3, 2, 4), segments=64))
+with tempfile.TemporaryDirectory() as directory:
+    cache = MeshCache(directory)
+    for run in range(2):
+        arrays = measure("cache {}".format(run),
+                         lambda: cache.get(obj, size_bound=0.1))
+    print(arrays.num_vertices(), "vertices", cache.hits, "hits", cache.misses, "misses")
+
+# repeated primitives and booleans are computed once
+from diffmesh import set_memo, memo_stats
+for capacity in [0, 1024]:
+    set_memo(capacity)
+    width = param(10, 0, 4)
+    radius = param(1, 1, 4)
+
+    def repeated():
+        obj = Object2d.rectangle(width, width)
+        for i in range(4):
+            for j in range(4):
+                hole = Object2d.circle(radius, segments=32).translate(2 * i - 3, 2 * j - 3)
+                obj = obj.difference(hole)
+        return obj.num_vertices()
+
+    for run in range(2):
+        measure("memo {} {}".format(capacity, run), repeated)
+    print(memo_stats())
+set_memo(0)
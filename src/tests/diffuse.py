@@ -15,6 +15,7 @@
 # along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 from diffmesh import Object2d, DiffReal, Mesh2d
+from diffmesh.meshcache import load_mesh
 
 import matplotlib.pyplot as plt
 from matplotlib.tri import Triangulation
@@ -39,8 +40,10 @@ mesh.refine_delaunay(size_bound=2.0)
 # mesh.plt_plot(derivs)
 
 num_vertices = mesh.num_vertices()
+faces = mesh.faces_array()
+
 matrix = numpy.zeros((num_vertices, num_vertices))
-for (v0, v1, v2) in mesh.faces():
+for (v0, v1, v2) in faces:
     matrix[v0, v1] = 1
     matrix[v0, v2] = 1
     matrix[v1, v0] = 1
@@ -48,8 +51,8 @@ for (v0, v1, v2) in mesh.faces():
     matrix[v2, v0] = 1
     matrix[v2, v1] = 1
 
-for v, p in enumerate(mesh.vertices()):
-    if object.contains(p) == 0:
+for v, c in enumerate(object.contains_many(mesh.vertices())):
+    if c == 0:
         matrix[v, :] = 0
     matrix[v, v] = 1
 
@@ -57,17 +60,18 @@ matrix /= numpy.sum(matrix, axis=1, keepdims=True)
 
 
 points = numpy.zeros((num_vertices, 2, 1 + len(derivs)), dtype=float)
-for v, p in enumerate(mesh.vertices()):
-    for i in [0, 1]:
-        points[v, i, 0] = p[i].value()
-        points[v, i, 1:] = p[i].derivs(len(derivs))
+points[:, :, 0] = mesh.values_array()
+points[:, :, 1:] = mesh.derivs_array(len(derivs))
 
 # diffuse everything
 for _ in range(100):
     points = numpy.einsum("ij,jkl->ikl", matrix, points)
 
+# the native kernel applies the same operator
+assert numpy.allclose(mesh.diffuse(100, len(derivs)), points)
+
 
-triangles = Triangulation(points[:, 0, 0], points[:, 1, 0], mesh.faces())
+triangles = Triangulation(points[:, 0, 0], points[:, 1, 0], faces)
 
 _, ax = plt.subplots()
 ax.set_aspect('equal')
@@ -85,15 +89,27 @@ assert object.num_polygons() == 2
 object_outer = object.get_polygon(0)
 object_inner = object.get_polygon(1)
 boundary = numpy.zeros((num_vertices, ), dtype=int)
-for v, p in enumerate(mesh.vertices()):
-    if object_inner.contains(p) == 0:
+inner = object_inner.contains_many(mesh.vertices())
+outer = object_outer.contains_many(mesh.vertices())
+for v in range(num_vertices):
+    if inner[v] == 0:
         assert boundary[v] in [0, 1]
         boundary[v] = 1
-    if object_outer.contains(p) == 0:
+    if outer[v] == 0:
         assert boundary[v] in [0, 2]
         boundary[v] = 2
-
-faces = numpy.array(mesh.faces(), dtype=int)
+assert numpy.array_equal(boundary != 0, mesh.boundary_array() != 0)
 
 numpy.savez("diffuse.npz", points=points,
-            faces=mesh.faces(), boundary=boundary)
+            faces=faces, boundary=boundary)
+
+# the binary file maps back to the same arrays
+mesh.save("diffuse.mesh", exact=True)
+saved = load_mesh("diffuse.mesh")
+assert numpy.array_equal(saved.values, mesh.values_array())
+assert numpy.array_equal(saved.faces, faces)
+assert numpy.array_equal(saved.boundary, mesh.boundary_array())
+assert numpy.array_equal(saved.derivs, mesh.derivs_array(mesh.num_derivs()))
+
+object.save("diffuse.obj2d", exact=True)
+assert Object2d.load("diffuse.obj2d").hash() == object.hash()
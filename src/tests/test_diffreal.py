@@ -14,6 +14,7 @@
 # You should have received a copy of the GNU General Public License
 # along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+import diffmesh
 from diffmesh import DiffReal
 
 a = DiffReal(2.0, [1.0, 0.0])
@@ -39,3 +40,25 @@ print(g.value(), g.derivs())
 
 h = a * g
 print(h.value(), h.derivs())
+
+s = DiffReal(2.0, [0, 7], [1.0, 0.0])
+print(s.value(), s.is_sparse(), s.derivs())
+
+t = DiffReal(3.0, [7, 2], [1.0, -4.0])
+u = s * t + s
+print(u.value(), u.is_sparse(), u.derivs(), u.derivs(10))
+
+v = u * a
+print(v.value(), v.is_sparse(), v.derivs())
+
+# lazy exact values are evaluated before they are shared, so every build is parallel
+diffmesh.set_num_threads(4)
+assert diffmesh.get_num_threads() == 4
+diffmesh.set_num_threads(0)
+
+# sparse indices are stored in 32 bits
+try:
+    DiffReal(2.0, [2**32], [1.0])
+    assert False
+except ValueError:
+    pass
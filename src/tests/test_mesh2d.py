@@ -14,7 +14,8 @@
 # You should have received a copy of the GNU General Public License
 # along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
-from diffmesh import Object2d, DiffReal, Mesh2d
+import diffmesh
+from diffmesh import Object2d, DiffReal, Mesh2d, Tape
 
 
 def test1():
@@ -49,9 +50,145 @@ def test2():
 
     m = Mesh2d(s)
     m.refine_delaunay(size_bound=1.5)
+    print("lloyd iterations", m.lloyd_optimize(max_iteration_number=10))
     # print(m.vertices())
     # print(m.faces())
     m.plt_plot([1.0, 0, 0, 0])
 
 
+def test3():
+    def build(width, height):
+        r = Object2d.rectangle(width, height)
+        c = Object2d.circle(height * DiffReal(0.25))
+        m = Mesh2d(r.difference(c))
+        m.refine_delaunay(size_bound=1.0)
+        return m
+
+    width = DiffReal(10, [1, 0])
+    height = DiffReal(8, [0, 1])
+
+    # forward mode: sum of the x coordinates of all vertices
+    m = build(width, height)
+    print([sum(v[0].derivs(2)[i] for v in m.vertices()) for i in range(2)])
+
+    # reverse mode: same gradient in a single backward sweep
+    tape = Tape()
+    tape.start()
+    m = build(tape.variable(width), tape.variable(height))
+    tape.stop()
+    print(m.gradient(tape, [(1.0, 0.0)] * m.num_vertices(), 2))
+
+    # recorded values cannot be used while the tape is stopped
+    v = tape.variable(width)
+    try:
+        v * v
+    except RuntimeError:
+        pass
+    else:
+        assert False, "derivatives were dropped"
+
+    # the vertices belong to this tape, not to another or a cleared one
+    other = Tape()
+    for t in [other, tape]:
+        if t is tape:
+            tape.clear()
+        try:
+            m.gradient(t, [(1.0, 0.0)] * m.num_vertices(), 2)
+        except ValueError:
+            continue
+        assert False, "foreign nodes were accepted"
+
+
+def test4():
+    width = DiffReal(10, [1, 0])
+    height = DiffReal(8, [0, 1])
+    r = Object2d.rectangle(width, height)
+    m = Mesh2d(r.difference(Object2d.circle(height * DiffReal(0.25))))
+    m.refine_delaunay(size_bound=1.0)
+
+    # the numpy exports agree with the per vertex objects
+    values = m.values_array()
+    derivs = m.derivs_array(2)
+    faces = m.faces_array()
+    assert values.shape == (m.num_vertices(), 2)
+    assert derivs.shape == (m.num_vertices(), 2, 2)
+    assert faces.shape == (m.num_faces(), 3)
+    for i, v in enumerate(m.vertices()):
+        assert list(values[i]) == [v[0].value(), v[1].value()]
+        assert list(derivs[i, 0]) == v[0].derivs(2)
+        assert list(derivs[i, 1]) == v[1].derivs(2)
+    assert [tuple(f) for f in faces] == m.faces()
+
+    # the writers stream the same vertices and faces
+    import os
+    import tempfile
+    with tempfile.TemporaryDirectory() as directory:
+        path = os.path.join(directory, "mesh.obj")
+        m.write_obj(path)
+        with open(path) as file:
+            lines = file.read().splitlines()
+        assert len(lines) == m.num_vertices() + m.num_faces()
+        assert lines[-1] == "f {} {} {}".format(*(faces[-1] + 1))
+
+        m.write_vtu(os.path.join(directory, "mesh.vtu"), num_derivs=2)
+        m.write_gmsh(os.path.join(directory, "mesh.msh"))
+
+
+def test5():
+    def build(width, height):
+        r = Object2d.rectangle(DiffReal(width, [1, 0]), DiffReal(height, [0, 1]))
+        return r.difference(Object2d.circle(DiffReal(0.25 * height, [0, 0.25])))
+
+    m = Mesh2d(build(10, 8))
+    m.refine_delaunay(size_bound=1.0)
+
+    # a small step only moves the vertices
+    assert m.reevaluate(build(10.1, 8.05), [0.1, 0.05])
+    print(m.num_vertices(), m.timings())
+
+    # a large step may rebuild the mesh, either way it stays usable
+    print("moved", m.reevaluate(build(30, 8), [19.9, 0.0]))
+    assert m.values_array().shape == (m.num_vertices(), 2)
+
+
+def test6():
+    diffmesh.reset_stats()
+    diffmesh.set_stats(True)
+    o = Object2d.rectangle(DiffReal(10, [1, 0]), DiffReal(8, [0, 1]))
+    m = Mesh2d(o.difference(Object2d.circle(DiffReal(2.0, [0, 0.25]))))
+    m.refine_delaunay(size_bound=1.0)
+    diffmesh.set_stats(False)
+
+    stats = diffmesh.stats()
+    print(stats)
+    assert stats["steiner_points"] > 0 and "mesh.refine" in stats["timers"]
+    diffmesh.write_trace("test6_trace.json")
+
+
+def test7():
+    recipe = diffmesh.Recipe()
+    plate = recipe.rectangle(recipe.parameter(0), recipe.parameter(1))
+    hole = recipe.circle(recipe.parameter(2), 32)
+    recipe.difference(plate, hole)
+    recipe.set_refine(size_bound=1.0)
+
+    # the meshes outlive the arena scopes of the sweep
+    diffmesh.set_arena(True)
+    try:
+        meshes = recipe.sweep([[10.0, 8.0, 2.0], [12.0, 8.0, 3.0], [9.0, 9.0, 1.0]])
+    finally:
+        diffmesh.set_arena(False)
+
+    for mesh in meshes:
+        mesh.refine_delaunay(size_bound=0.5)
+        assert mesh.values_array().shape == (mesh.num_vertices(), 2)
+        assert mesh.derivs_array(3).shape == (mesh.num_vertices(), 2, 3)
+    del meshes
+
+
 test1()
+test3()
+test4()
+test5()
+test6()
+test7()
@@ -14,7 +14,7 @@
 # You should have received a copy of the GNU General Public License
 # along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
-from diffmesh import Object2d, DiffReal
+from diffmesh import Object2d, DiffReal, set_stats, stats, reset_stats
 
 rwidth = DiffReal(10, [1, 0, 0, 0])
 rheight = DiffReal(10, [0, 1, 0, 0])
@@ -33,4 +33,43 @@ s = s.difference(c.translate(12, -5))
 s = s.join(c.translate(13, -6))
 s = s.intersection(r.scale(2.0).rotate(angle))
 
+# snapping keeps the structure, while the rotated rationals get short
+reset_stats()
+set_stats(True)
+t = s.snap_bits(20)
+set_stats(False)
+assert t.num_components() == s.num_components()
+assert t.num_polygons() == s.num_polygons()
+assert t.num_vertices() <= s.num_vertices()
+snapped = stats()
+assert snapped["snap_bits_out"] < snapped["snap_bits_in"]
+
+# the segments follow the chord tolerance and the edge length
+assert Object2d.circle(DiffReal(1.0), tolerance=0.01).num_vertices() == 23
+assert Object2d.circle(DiffReal(10.0), edge_length=1.0).num_vertices() == 63
+assert Object2d.arc(DiffReal(1.0), 0.0, 1.5, segments=3).num_vertices() == 5
+assert Object2d.rounded_rectangle(DiffReal(4), DiffReal(2), DiffReal(1), 2).num_vertices() == 10
+for segments in [0, 2]:
+    try:
+        Object2d.circle(DiffReal(1.0), segments)
+        assert False
+    except ValueError:
+        pass
+
+# the fast kernel, when it is built, sees the same structure
+try:
+    import diffmesh.fast as fast
+except ImportError:
+    fast = None
+if fast is not None:
+    plate = fast.Object2d.rectangle(fast.DiffReal(10, [1, 0]), fast.DiffReal(10, [0, 1]))
+    holes = fast.Object2d()
+    for i in range(3):
+        holes = holes.join(fast.Object2d.circle(fast.DiffReal(1.2), 32).translate(3.0 * i - 3.0, 0.5 * i))
+    plate = plate.difference(holes)
+    assert plate.num_components() == 1 and plate.num_polygons() == 4
+    mesh = fast.Mesh2d(plate)
+    mesh.refine_delaunay(size_bound=0.5)
+    assert mesh.num_vertices() > plate.num_vertices()
+
 s.plt_plot([0.0, 0.0, 1.0, 0.0])